@@ -0,0 +1,94 @@
+#!/usr/bin/perl
+use 5.16.0;
+use warnings FATAL => 'all';
+
+# Sequential and random throughput on multi-MB files in a fresh image, and
+# getattr latency at the bottom of a deep directory tree.
+# Usage: perl bench.pl [file size in MB] [random I/O count] [tree depth]
+
+use Time::HiRes qw(time);
+
+my $mb = $ARGV[0] || 16;
+my $ops = $ARGV[1] || 4096;
+my $depth = $ARGV[2] || 16;
+my $io = 4096;
+
+sub mount {
+    system("(make mount 2>&1) >> bench.log &");
+    sleep 1;
+}
+
+sub unmount {
+    system("(make unmount 2>&1) >> bench.log");
+}
+
+sub report {
+    my ($what, $bytes, $secs) = @_;
+    printf("%-24s %8.1f MB/s\n", $what, $bytes / $secs / (1 << 20));
+}
+
+system("rm -f data.nufs bench.log");
+mount();
+
+my $chunk = "x" x (128 << 10);
+my $total = $mb << 20;
+
+my $t = time();
+open my $fh, ">", "mnt/big.bin" or die "cannot create mnt/big.bin";
+binmode $fh;
+for (my $done = 0; $done < $total; $done += length $chunk) {
+    print $fh $chunk;
+}
+close $fh;
+report("sequential write", $total, time() - $t);
+
+$t = time();
+open $fh, "<", "mnt/big.bin" or die "cannot open mnt/big.bin";
+binmode $fh;
+my $data;
+my $read = 0;
+while (my $n = sysread($fh, $data, length $chunk)) {
+    $read += $n;
+}
+close $fh;
+$read == $total or die "read back $read of $total bytes";
+report("sequential read", $total, time() - $t);
+
+srand(1);
+my $blocks = $total / $io;
+
+$t = time();
+open $fh, "<", "mnt/big.bin" or die "cannot open mnt/big.bin";
+binmode $fh;
+for (1 .. $ops) {
+    sysseek($fh, int(rand($blocks)) * $io, 0);
+    sysread($fh, $data, $io) == $io or die "short random read";
+}
+close $fh;
+report("random ${io}B read", $ops * $io, time() - $t);
+
+my $block = "y" x $io;
+$t = time();
+open $fh, "+<", "mnt/big.bin" or die "cannot open mnt/big.bin";
+binmode $fh;
+for (1 .. $ops) {
+    sysseek($fh, int(rand($blocks)) * $io, 0);
+    syswrite($fh, $block) == $io or die "short random write";
+}
+close $fh;
+report("random ${io}B write", $ops * $io, time() - $t);
+
+# The kernel caches attributes of names that exist, but asks again for
+# every name that does not, so stat misses reach getattr each time.
+my $dir = "mnt";
+for my $level (1 .. $depth) {
+    $dir .= "/d$level";
+    mkdir $dir or die "cannot create $dir";
+}
+$t = time();
+for my $i (1 .. $ops) {
+    stat("$dir/missing$i") and die "$dir/missing$i exists";
+}
+printf("%-24s %8.1f us\n", "getattr miss, depth $depth", (time() - $t) / $ops * 1e6);
+
+unmount();
@@ -34,6 +34,69 @@ void bitmap_put(void *bm, int i, int v) {
   }
 }
 
+// Find the first bit with the given value in [from, size), a 64-bit word at a time.
+// The bitmap is read as little-endian words, so bit i is bit i % 64 of word i / 64,
+// matching byte_index and bit_index. Bitmaps fill whole blocks, so the last
+// word is always readable.
+static int find_bit(void *bm, int from, int size, int value) {
+  if (from >= size) {
+    return -1;
+  }
+  uint64_t *words = (uint64_t *) bm;
+  uint64_t flip = value ? 0 : ~0ULL;
+  int w = from / 64;
+  int last = (size - 1) / 64;
+
+  // bits below from in the first word do not count
+  uint64_t hits = (words[w] ^ flip) & (~0ULL << (from % 64));
+  while (hits == 0) {
+    if (++w > last) {
+      return -1;
+    }
+    hits = words[w] ^ flip;
+  }
+  int i = w * 64 + __builtin_ctzll(hits);
+  return i < size ? i : -1;
+}
+
+// Find the first clear bit at or after from.
+int bitmap_find_free(void *bm, int from, int size) {
+  return find_bit(bm, from, size, 0);
+}
+
+// Find the first run of count clear bits at or after from.
+int bitmap_find_run(void *bm, int from, int size, int count) {
+  while (from < size) {
+    int start = find_bit(bm, from, size, 0);
+    if (start == -1) {
+      return -1;
+    }
+    // the run ends at the next set bit, or at the end of the bitmap
+    int end = find_bit(bm, start, size, 1);
+    if (end == -1) {
+      end = size;
+    }
+    if (end - start >= count) {
+      return start;
+    }
+    from = end;
+  }
+  return -1;
+}
+
+// Count the set bits among the first size bits.
+int bitmap_count(void *bm, int size) {
+  uint64_t *words = (uint64_t *) bm;
+  int count = 0;
+  for (int w = 0; w < size / 64; w++) {
+    count += __builtin_popcountll(words[w]);
+  }
+  for (int i = size / 64 * 64; i < size; i++) {
+    count += bitmap_get(bm, i);
+  }
+  return count;
+}
+
 // Pretty-print the bitmap (with the given no. of bits).
 void bitmap_print(void *bm, int size) {
 
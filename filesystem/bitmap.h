@@ -26,6 +26,39 @@ int bitmap_get(void *bm, int i);
  */
 void bitmap_put(void *bm, int i, int v);
 
+/**
+ * Find the first clear bit in the given range, scanning 64 bits at a time.
+ *
+ * @param bm Pointer to the start of the bitmap.
+ * @param from Index of the first bit to look at.
+ * @param size Number of bits in the bitmap.
+ *
+ * @return The index of the first 0 bit at or after from, or -1 if there is none.
+ */
+int bitmap_find_free(void *bm, int from, int size);
+
+/**
+ * Find the first run of consecutive clear bits in the given range.
+ *
+ * @param bm Pointer to the start of the bitmap.
+ * @param from Index of the first bit to look at.
+ * @param size Number of bits in the bitmap.
+ * @param count Length of the run.
+ *
+ * @return The index of the first bit of the run, or -1 if there is none.
+ */
+int bitmap_find_run(void *bm, int from, int size, int count);
+
+/**
+ * Count the set bits in the bitmap.
+ *
+ * @param bm Pointer to the start of the bitmap.
+ * @param size The number of bits to count over.
+ *
+ * @return The number of 1 bits.
+ */
+int bitmap_count(void *bm, int size);
+
 /**
  * Pretty-print a bitmap. 
  *
@@ -10,8 +10,10 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -19,16 +21,14 @@
 
 #include "bitmap.h"
 #include "blocks.h"
+#include "inode.h"
 
-extern const int BLOCK_COUNT = 256;                    // we split the "disk" into 256 blocks
-extern const int BLOCK_SIZE = 4096;                    // = 4K
-extern const int NUFS_SIZE = BLOCK_SIZE * BLOCK_COUNT; // = 1MB
-
-extern const int BLOCK_BITMAP_SIZE = BLOCK_COUNT / 8;
-// Note: assumes block count is divisible by 8
+extern const int BLOCK_SIZE = 4096; // = 4K
 
 static int blocks_fd = -1;
 static void *blocks_base = 0;
+static size_t blocks_size = 0; // bytes mapped
+static int blocks_hint = 0;    // where the next allocation starts looking
 
 // Get the number of blocks needed to store the given number of bytes.
 int bytes_to_blocks(int bytes)
@@ -45,63 +45,165 @@ int bytes_to_blocks(int bytes)
   }
 }
 
-// Load and initialize the given disk image.
+// Create a new, empty disk image of the given size.
+int blocks_format(const char *image_path, long size)
+{
+  long block_count = size / BLOCK_SIZE;
+  if (size < NUFS_MIN_SIZE || block_count > INT_MAX)
+  {
+    fprintf(stderr, "image size %ld out of range\n", size);
+    return -1;
+  }
+
+  // truncating to 0 first leaves every block zero-filled (and the file sparse)
+  int fd = open(image_path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+  if (fd == -1)
+  {
+    return -1;
+  }
+  if (ftruncate(fd, block_count * BLOCK_SIZE) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+
+  // lay out the bitmaps and the inode table, each one as long as it needs
+  int bits_per_block = BLOCK_SIZE * 8;
+  int inodes_per_block = BLOCK_SIZE / sizeof(inode_t);
+  long inode_blocks = (size / NUFS_BYTES_PER_INODE + inodes_per_block - 1) / inodes_per_block;
+
+  superblock_t sb;
+  sb.magic = NUFS_MAGIC;
+  sb.block_size = BLOCK_SIZE;
+  sb.block_count = block_count;
+  sb.inode_count = inode_blocks * inodes_per_block;
+  sb.block_bitmap_start = 1;
+  sb.inode_bitmap_start = sb.block_bitmap_start + (block_count + bits_per_block - 1) / bits_per_block;
+  sb.inode_table_start = sb.inode_bitmap_start + (sb.inode_count + bits_per_block - 1) / bits_per_block;
+  sb.data_start = sb.inode_table_start + inode_blocks;
+  sb.free_blocks = block_count - sb.data_start;
+  sb.free_inodes = sb.inode_count;
+
+  // write the superblock and mark the blocks it describes as allocated
+  size_t meta_size = (size_t)sb.data_start * BLOCK_SIZE;
+  void *meta = mmap(0, meta_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (meta == MAP_FAILED)
+  {
+    close(fd);
+    return -1;
+  }
+  memcpy(meta, &sb, sizeof(sb));
+  void *bbm = meta + (size_t)sb.block_bitmap_start * BLOCK_SIZE;
+  for (int ii = 0; ii < sb.data_start; ++ii)
+  {
+    bitmap_put(bbm, ii, 1);
+  }
+  munmap(meta, meta_size);
+  close(fd);
+  return 0;
+}
+
+// Load the given disk image, formatting it first if it is new.
 void blocks_init(const char *image_path)
 {
-  blocks_fd = open(image_path, O_CREAT | O_RDWR, 0644);
+  struct stat st;
+  if (stat(image_path, &st) != 0 || st.st_size == 0)
+  {
+    int rv = blocks_format(image_path, NUFS_DEFAULT_SIZE);
+    assert(rv == 0);
+  }
+
+  blocks_fd = open(image_path, O_RDWR);
   assert(blocks_fd != -1);
 
-  // make sure the disk image is exactly 1MB
-  int rv = ftruncate(blocks_fd, NUFS_SIZE);
+  // the superblock tells how much of the image to map
+  superblock_t sb;
+  ssize_t got = pread(blocks_fd, &sb, sizeof(sb), 0);
+  int rv = fstat(blocks_fd, &st);
   assert(rv == 0);
+  // a short read means the file is too small to hold a superblock at all
+  if (got != (ssize_t)sizeof(sb) || sb.magic != NUFS_MAGIC || sb.block_size != BLOCK_SIZE ||
+      sb.block_count <= 0 || (size_t)st.st_size < (size_t)sb.block_count * BLOCK_SIZE)
+  {
+    fprintf(stderr, "%s is not a nufs image\n", image_path);
+    exit(1);
+  }
+  blocks_size = (size_t)sb.block_count * BLOCK_SIZE;
 
   // map the image to memory
-  blocks_base = mmap(0, NUFS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, blocks_fd, 0);
+  blocks_base = mmap(0, blocks_size, PROT_READ | PROT_WRITE, MAP_SHARED, blocks_fd, 0);
   assert(blocks_base != MAP_FAILED);
 
-  // block 0 stores the block bitmap and the inode bitmap
-  void *bbm = get_blocks_bitmap();
-  bitmap_put(bbm, 0, 1);
+  // recount the free blocks and inodes, in case the image was not closed cleanly
+  superblock_t *sbp = get_superblock();
+  sbp->free_blocks = sbp->block_count - bitmap_count(get_blocks_bitmap(), sbp->block_count);
+  sbp->free_inodes = sbp->inode_count - bitmap_count(get_inode_bitmap(), sbp->inode_count);
+  blocks_hint = sbp->data_start;
 }
 
 // Close the disk image
 void blocks_free()
 {
-  int rv = munmap(blocks_base, NUFS_SIZE);
+  int rv = munmap(blocks_base, blocks_size);
   assert(rv == 0);
+  close(blocks_fd);
+  blocks_fd = -1;
 }
 
+// Return a pointer to the superblock of the loaded image
+superblock_t *get_superblock() { return blocks_base; }
+
 // Get the given block, returning a pointer to its start
-void *blocks_get_block(int bnum) { return blocks_base + BLOCK_SIZE * bnum; }
+void *blocks_get_block(int bnum) { return blocks_base + (size_t)BLOCK_SIZE * bnum; }
 
 // Return a pointer to the beginning of the block bitmap
-// The size is BLOCK_BITMAP_SIZE bytes.
-void *get_blocks_bitmap() { return blocks_get_block(0); }
+// The size is one bit per block in the image.
+void *get_blocks_bitmap() { return blocks_get_block(get_superblock()->block_bitmap_start); }
 
 // Return a pointer to the beginning of the inode table bitmap
-void *get_inode_bitmap()
-{
-  uint8_t *block = blocks_get_block(0);
+void *get_inode_bitmap() { return blocks_get_block(get_superblock()->inode_bitmap_start); }
 
-  // The inode bitmap is stored immediately after the block bitmap
-  return (void *)(block + BLOCK_BITMAP_SIZE);
+// Allocate a new zero-filled block and return its index
+int alloc_block()
+{
+  int bnum = alloc_run(1);
+  if (bnum != -1)
+  {
+    printf("+ alloc_block() -> %d\n", bnum);
+  }
+  return bnum;
 }
 
-// Allocate a new block and return its index
-int alloc_block()
+// Allocate a run of zero-filled blocks and return the index of the first
+int alloc_run(int count)
 {
+  superblock_t *sb = get_superblock();
+  if (sb->free_blocks < count)
+  {
+    return -1;
+  }
+
+  // continue after the last allocation, then wrap around to the start
   void *bbm = get_blocks_bitmap();
+  int bnum = bitmap_find_run(bbm, blocks_hint, sb->block_count, count);
+  if (bnum == -1)
+  {
+    int wrap_end = blocks_hint + count - 1 < sb->block_count ? blocks_hint + count - 1 : sb->block_count;
+    bnum = bitmap_find_run(bbm, sb->data_start, wrap_end, count);
+  }
+  if (bnum == -1)
+  {
+    return -1;
+  }
 
-  for (int ii = 1; ii < BLOCK_COUNT; ++ii)
+  for (int ii = bnum; ii < bnum + count; ++ii)
   {
-    if (!bitmap_get(bbm, ii))
-    {
-      bitmap_put(bbm, ii, 1);
-      printf("+ alloc_block() -> %d\n", ii);
-      return ii;
-    }
+    bitmap_put(bbm, ii, 1);
   }
-  return -1;
+  memset(blocks_get_block(bnum), 0, (size_t)BLOCK_SIZE * count);
+  sb->free_blocks -= count;
+  blocks_hint = bnum + count;
+  return bnum;
 }
 
 // Deallocate the block with the given index
@@ -109,5 +211,9 @@ void free_block(int bnum)
 {
   printf("+ free_block(%d)\n", bnum);
   void *bbm = get_blocks_bitmap();
-  bitmap_put(bbm, bnum, 0);
+  if (bitmap_get(bbm, bnum))
+  {
+    bitmap_put(bbm, bnum, 0);
+    get_superblock()->free_blocks += 1;
+  }
 }
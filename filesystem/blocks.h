@@ -5,19 +5,40 @@
  * A block-based abstraction over a disk image file.
  *
  * The disk image is mmapped, so block data is accessed using pointers.
+ *
+ * Block 0 holds the superblock, which records the layout of the image:
+ * the block bitmap, the inode bitmap and the inode table follow it, each
+ * spanning as many blocks as the image size needs, and the data blocks come
+ * after them.
  */
 #ifndef BLOCKS_H
 #define BLOCKS_H
 
 #include <stdio.h>
 
-extern const int BLOCK_COUNT; // we split the "disk" into blocks (default = 256)
 extern const int BLOCK_SIZE;  // default = 4K
-extern const int NUFS_SIZE;   // default = 1MB
 
-extern const int BLOCK_BITMAP_SIZE; // default = 256 / 8 = 32
+#define NUFS_MAGIC 0x5346554e          // "NUFS"
+#define NUFS_DEFAULT_SIZE (64L << 20)  // size of an image created on mount
+#define NUFS_MIN_SIZE (1L << 20)       // smallest image blocks_format() accepts
+// One inode for every 16K of the image, so the default image holds 4096
+// files and a directory of 100k entries needs an image of at least 1.6 GB.
+#define NUFS_BYTES_PER_INODE (16 << 10)
+
+typedef struct superblock {
+  int magic;               // NUFS_MAGIC
+  int block_size;          // bytes per block
+  int block_count;         // blocks in the image
+  int inode_count;         // inodes in the inode table
+  int block_bitmap_start;  // first block of the block bitmap
+  int inode_bitmap_start;  // first block of the inode bitmap
+  int inode_table_start;   // first block of the inode table
+  int data_start;          // first block available for data
+  int free_blocks;         // blocks not yet allocated, kept up to date by alloc/free
+  int free_inodes;         // inodes not yet allocated, kept up to date by alloc/free
+} superblock_t;
 
-/** 
+/**
  * Compute the number of blocks needed to store the given number of bytes.
  *
  * @param bytes Size of data to store in bytes.
@@ -27,7 +48,25 @@ extern const int BLOCK_BITMAP_SIZE; // default = 256 / 8 = 32
 int bytes_to_blocks(int bytes);
 
 /**
- * Load and initialize the given disk image.
+ * Create a new, empty disk image of the given size.
+ *
+ * Lays out the superblock, the bitmaps and the inode table and marks their
+ * blocks as allocated. An existing file at the path is overwritten.
+ *
+ * @param image_path Path to the disk image file.
+ * @param size Size of the image in bytes, rounded down to whole blocks.
+ *
+ * @return 0 on success, -1 if the size is out of range or the image cannot
+ *         be created.
+ */
+int blocks_format(const char *image_path, long size);
+
+/**
+ * Load the given disk image.
+ *
+ * A missing or empty image is first formatted with NUFS_DEFAULT_SIZE. The
+ * free block and inode counts in the superblock are recounted from the
+ * bitmaps.
  *
  * @param image_path Path to the disk image file.
  */
@@ -38,6 +77,13 @@ void blocks_init(const char *image_path);
  */
 void blocks_free();
 
+/**
+ * Return a pointer to the superblock of the loaded image.
+ *
+ * @return A pointer to the superblock in block 0.
+ */
+superblock_t *get_superblock();
+
 /**
  * Get the block with the given index, returning a pointer to its start.
  *
@@ -64,12 +110,27 @@ void *get_inode_bitmap();
 /**
  * Allocate a new block and return its number.
  *
- * Grabs the first unused block and marks it as allocated.
+ * Grabs the first unused block at or after the one following the last
+ * allocation (next-fit), wrapping around to the start of the data area,
+ * marks it as allocated and fills it with zeros.
  *
- * @return The index of the newly allocated block.
+ * @return The index of the newly allocated block, or -1 if the disk is full.
  */
 int alloc_block();
 
+/**
+ * Allocate a run of consecutive blocks and return the first one.
+ *
+ * Searches next-fit like alloc_block(), and marks and zero-fills every
+ * block of the run.
+ *
+ * @param count Number of blocks in the run.
+ *
+ * @return The index of the first block, or -1 if there is no free run of
+ *         that length.
+ */
+int alloc_run(int count);
+
 /**
  * Deallocate the block with the given number.
  *
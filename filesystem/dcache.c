@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dcache.h"
+
+typedef struct dentry
+{
+  char *path;          // path without its leading slashes
+  int inum;            // inode number, -1 for a negative entry
+  struct dentry *next; // next entry in the bucket
+} dentry_t;
+
+static dentry_t *buckets[DCACHE_BUCKETS];
+static int entries = 0;
+
+// Skip the leading slashes of a path
+static const char *dcache_key(const char *path)
+{
+  while (*path == '/')
+  {
+    path++;
+  }
+  return path;
+}
+
+// FNV-1a hash of a key, reduced to a bucket index
+static unsigned dcache_bucket(const char *key)
+{
+  uint32_t hash = 2166136261u;
+  for (; *key; key++)
+  {
+    hash = (hash ^ (uint8_t)*key) * 16777619u;
+  }
+  return hash & (DCACHE_BUCKETS - 1);
+}
+
+// Find the link pointing at the entry for a key, or at the end of its bucket
+static dentry_t **dcache_find(const char *key)
+{
+  dentry_t **link = &buckets[dcache_bucket(key)];
+  while (*link && strcmp((*link)->path, key) != 0)
+  {
+    link = &(*link)->next;
+  }
+  return link;
+}
+
+// Unlink and free the entry the given link points at
+static void dcache_remove(dentry_t **link)
+{
+  dentry_t *entry = *link;
+  *link = entry->next;
+  free(entry->path);
+  free(entry);
+  entries--;
+}
+
+// Look up a path in the cache
+int dcache_get(const char *path, int *inum)
+{
+  dentry_t *entry = *dcache_find(dcache_key(path));
+  if (entry == NULL)
+  {
+    return 0;
+  }
+  *inum = entry->inum;
+  return 1;
+}
+
+// Cache the inode number (or -1 for a miss) of a path
+void dcache_put(const char *path, int inum)
+{
+  const char *key = dcache_key(path);
+  dentry_t **link = dcache_find(key);
+  if (*link)
+  {
+    (*link)->inum = inum;
+    return;
+  }
+
+  // keep the cache bounded; it refills from the directories as needed
+  if (entries == DCACHE_MAX)
+  {
+    dcache_clear();
+    link = dcache_find(key);
+  }
+  // the cache is only a shortcut, so a failed allocation just skips caching
+  dentry_t *entry = malloc(sizeof(dentry_t));
+  if (entry == NULL)
+  {
+    return;
+  }
+  entry->path = strdup(key);
+  if (entry->path == NULL)
+  {
+    free(entry);
+    return;
+  }
+  entry->inum = inum;
+  entry->next = NULL;
+  *link = entry;
+  entries++;
+}
+
+// Drop the entry for a path
+void dcache_invalidate(const char *path)
+{
+  dentry_t **link = dcache_find(dcache_key(path));
+  if (*link)
+  {
+    dcache_remove(link);
+  }
+}
+
+// Drop the entries for a path and for everything below it
+void dcache_invalidate_tree(const char *path)
+{
+  const char *key = dcache_key(path);
+  size_t len = strlen(key);
+  for (int ii = 0; ii < DCACHE_BUCKETS; ++ii)
+  {
+    dentry_t **link = &buckets[ii];
+    while (*link)
+    {
+      const char *other = (*link)->path;
+      if (strncmp(other, key, len) == 0 && (other[len] == '\0' || other[len] == '/'))
+      {
+        dcache_remove(link);
+      }
+      else
+      {
+        link = &(*link)->next;
+      }
+    }
+  }
+}
+
+// Drop every entry
+void dcache_clear()
+{
+  for (int ii = 0; ii < DCACHE_BUCKETS; ++ii)
+  {
+    while (buckets[ii])
+    {
+      dcache_remove(&buckets[ii]);
+    }
+  }
+}
@@ -0,0 +1,33 @@
+// Dentry cache: an in-memory hash table from paths to inode numbers.
+//
+// tree_lookup() consults it before walking the directories, so resolving a
+// path that was seen before costs one hash lookup. Misses are cached as well
+// (negative entries, inum -1). Leading slashes are ignored, so "/a/b" and
+// "a/b" share an entry.
+//
+// Anything that adds, removes or moves a directory entry must invalidate the
+// paths it affects.
+
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#define DCACHE_BUCKETS 4096  // hash buckets (a power of two)
+#define DCACHE_MAX 65536     // entries held before the cache is flushed
+
+// Look up a path. Returns 1 and sets *inum (-1 for a cached miss) on a hit,
+// 0 if the path is not cached.
+int dcache_get(const char *path, int *inum);
+
+// Cache the inode number of a path, or -1 to record that it does not exist.
+void dcache_put(const char *path, int inum);
+
+// Drop the entry for a path.
+void dcache_invalidate(const char *path);
+
+// Drop the entries for a path and for everything below it.
+void dcache_invalidate_tree(const char *path);
+
+// Drop every entry.
+void dcache_clear();
+
+#endif
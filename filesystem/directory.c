@@ -1,6 +1,9 @@
+#define _GNU_SOURCE
 #include <string.h>
 #include <assert.h>
+#include <sys/stat.h>
 #include "directory.h"
+#include "dcache.h"
 #include "blocks.h"
 
 // initialize the root directory
@@ -20,54 +23,214 @@ void directory_init()
     directory_put(inode, parent, inode_index);
 }
 
+// hash a directory entry name (32-bit FNV-1a)
+// Args: name to hash
+// Return: hash of the name
+static uint32_t dir_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (; *name; name++)
+    {
+        hash = (hash ^ (uint8_t)*name) * 16777619u;
+    }
+    return hash;
+}
+
+// get the header at the start of a directory
+// Args: directory node, and whether to allocate its first block if it is missing
+// Return: pointer to the header, or NULL if the directory has no blocks (or the disk is full)
+static dir_header_t *dir_header(inode_t *dd, int alloc)
+{
+    int bnum = inode_get_bnum(dd, 0, alloc);
+    if (bnum <= 0)
+    {
+        return NULL;
+    }
+    return (dir_header_t *)blocks_get_block(bnum);
+}
+
+// get an entry of the index, which follows the header
+// Args: directory node, index position, and whether to allocate its block if it is missing
+// Return: pointer to the index entry, or NULL if its block is missing
+static int *dir_index(inode_t *dd, uint32_t ii, int alloc)
+{
+    size_t offset = sizeof(dir_header_t) + ii * sizeof(int);
+    int bnum = inode_get_bnum(dd, offset / BLOCK_SIZE, alloc);
+    if (bnum <= 0)
+    {
+        return NULL;
+    }
+    return (int *)(blocks_get_block(bnum) + offset % BLOCK_SIZE);
+}
+
+// get the slots of a leaf, slot 0 is the dir_leaf_t header
+// Args: directory node, leaf number, and whether to allocate the leaf if it is missing
+// Return: pointer to the first slot, or NULL if the leaf is missing
+static dirent_t *dir_leaf(inode_t *dd, int leaf, int alloc)
+{
+    int bnum = inode_get_bnum(dd, DIR_LEAF_START + leaf, alloc);
+    if (bnum <= 0)
+    {
+        return NULL;
+    }
+    return (dirent_t *)blocks_get_block(bnum);
+}
+
+// find the leaf a hash belongs in
+// Args: directory node, its header, and the hash of a name
+// Return: leaf number
+static int dir_leaf_of(inode_t *dd, dir_header_t *hd, uint32_t hash)
+{
+    return *dir_index(dd, hash & ((1u << hd->depth) - 1), 0);
+}
+
+// find the entry with the given name
+// Args: directory node, name to look for, and where to return the slots of its leaf
+// Return: pointer to the entry, or NULL if there is none
+static dirent_t *dir_find(inode_t *dd, const char *name, dirent_t **slots)
+{
+    dir_header_t *hd = dir_header(dd, 0);
+    if (hd == NULL || hd->leaves == 0)
+    {
+        return NULL;
+    }
+    uint32_t hash = dir_hash(name);
+    dirent_t *ents = dir_leaf(dd, dir_leaf_of(dd, hd, hash), 0);
+    // compare the hashes first, so strcmp only runs on a likely match
+    for (int ii = 1; ii < DIR_LEAF_SLOTS; ii++)
+    {
+        if (ents[ii].hash == hash && ents[ii].name[0] != '\0' && strcmp(ents[ii].name, name) == 0)
+        {
+            *slots = ents;
+            return &ents[ii];
+        }
+    }
+    return NULL;
+}
+
+// split a full leaf in two on the next bit of the hash, doubling the index if needed
+// Args: directory node, its header, and the leaf to split
+// Return -1 on failure (the index is at its largest or the disk is full), 0 on success
+static int dir_split(inode_t *dd, dir_header_t *hd, int leaf)
+{
+    dirent_t *ents = dir_leaf(dd, leaf, 0);
+    dir_leaf_t *old = (dir_leaf_t *)ents;
+    int depth = old->depth;
+
+    if (depth == hd->depth)
+    {
+        if (hd->depth == DIR_MAX_DEPTH)
+        {
+            return -1;
+        }
+        // the new upper half of the index points at the same leaves as the lower half
+        uint32_t half = 1u << hd->depth;
+        for (uint32_t ii = 0; ii < half; ii++)
+        {
+            int *slot = dir_index(dd, half + ii, 1);
+            if (slot == NULL)
+            {
+                return -1;
+            }
+            *slot = *dir_index(dd, ii, 0);
+        }
+        hd->depth += 1;
+    }
+
+    int fresh = hd->leaves;
+    dirent_t *fresh_ents = dir_leaf(dd, fresh, 1);
+    if (fresh_ents == NULL)
+    {
+        return -1;
+    }
+    hd->leaves += 1;
+
+    // entries with the next hash bit set move to the new leaf
+    dir_leaf_t *split = (dir_leaf_t *)fresh_ents;
+    uint32_t low = ents[1].hash & ((1u << depth) - 1);
+    for (int ii = 1; ii < DIR_LEAF_SLOTS; ii++)
+    {
+        if (ents[ii].name[0] != '\0' && (ents[ii].hash >> depth) & 1)
+        {
+            split->count += 1;
+            memcpy(&fresh_ents[split->count], &ents[ii], sizeof(dirent_t));
+            memset(&ents[ii], 0, sizeof(dirent_t));
+            old->count -= 1;
+        }
+    }
+    old->depth = depth + 1;
+    split->depth = depth + 1;
+
+    // point the index entries for the moved hashes at the new leaf
+    for (uint32_t ii = low | (1u << depth); ii < (1u << hd->depth); ii += 2u << depth)
+    {
+        *dir_index(dd, ii, 0) = fresh;
+    }
+    return 0;
+}
+
 // return the inode index number of the given directory with the given name
 // Args: Directory node to look up, and name of directory we are searching for
 // Return -1 on failure, 0 on success
 int directory_lookup(inode_t *dd, const char *name)
 {
     assert(dd != NULL);
-    dirent_t *base = (dirent_t *)blocks_get_block(dd->block);
-    // For each entry in the inode, check if the name matches the given name to search for
-    dirent_t *dir;
-    for (int i = 0; i < dd->size; i++)
+    dirent_t *slots;
+    dirent_t *dir = dir_find(dd, name, &slots);
+    if (dir == NULL)
     {
-        dir = (dirent_t *)(base + i);
-        if (strcmp(dir->name, name) == 0)
-        {
-            // if the name matches, return the inode number
-            return dir->inum;
-        }
+        return -1;
     }
-    return -1;
+    return dir->inum;
 }
 
-// look up the given path from the root directory and return the inode index number
+// walk the given path from the root directory one component at a time
 // Args: path of file to look up in the file system
 // Return inode index number, or -1 on failure
-int tree_lookup(const char *path)
+static int tree_walk(const char *path)
 {
-    if (strcmp(path, "/") == 0)
-    {
-        return 0;
-    }
-    else if (path[0] == '/')
-    {
-        path++;
-    }
-    slist_t *exploded = s_explode(path, '/');
-    // Conduct a directory lookup on each entry in the 'exploded' path
     int inum = 0;
-    while (exploded && strlen(exploded->data) > 0)
+    char name[DIR_NAME_LENGTH];
+    while (*path != '\0')
     {
-
-        inum = directory_lookup(get_inode(inum), exploded->data);
+        if (*path == '/')
+        {
+            path++;
+            continue;
+        }
+        // copy out the next component and look it up in the current directory
+        const char *end = strchrnul(path, '/');
+        size_t len = end - path;
+        inode_t *dd = get_inode(inum);
+        if (len >= DIR_NAME_LENGTH || !S_ISDIR(dd->mode))
+        {
+            return -1;
+        }
+        memcpy(name, path, len);
+        name[len] = '\0';
+        inum = directory_lookup(dd, name);
         if (inum == -1)
         {
             return -1;
         }
-        exploded = exploded->next;
+        path = end;
     }
-    s_free(exploded);
+    return inum;
+}
+
+// look up the given path from the root directory and return the inode index number
+// Resolved paths and misses are remembered in the dentry cache.
+// Args: path of file to look up in the file system
+// Return inode index number, or -1 on failure
+int tree_lookup(const char *path)
+{
+    int inum;
+    if (dcache_get(path, &inum))
+    {
+        return inum;
+    }
+    inum = tree_walk(path);
+    dcache_put(path, inum);
     return inum;
 }
 
@@ -76,14 +239,56 @@ int tree_lookup(const char *path)
 // Return -1 on failure, 0 on success
 int directory_put(inode_t *dd, const char *name, int inum)
 {
-    // create a new directory node and insert the directory name and inum into the directory entry
-    dirent_t new_dir;
-    strcpy(new_dir.name, name);
-    new_dir.inum = inum;
-    dirent_t *current_dir = (dirent_t *)(blocks_get_block(dd->block));
-    memcpy(current_dir + dd->size, &new_dir, sizeof(dirent_t));
-    dd->size += 1; // update size in directory node
-    return 0;
+    if (strlen(name) >= DIR_NAME_LENGTH)
+    {
+        return -1;
+    }
+    dir_header_t *hd = dir_header(dd, 1);
+    if (hd == NULL)
+    {
+        return -1;
+    }
+    // an empty directory starts with a single leaf that every hash maps to
+    if (hd->leaves == 0)
+    {
+        int *first = dir_index(dd, 0, 1);
+        if (first == NULL || dir_leaf(dd, 0, 1) == NULL)
+        {
+            return -1;
+        }
+        *first = 0;
+        hd->leaves = 1;
+    }
+
+    uint32_t hash = dir_hash(name);
+    for (;;)
+    {
+        int leaf = dir_leaf_of(dd, hd, hash);
+        dirent_t *ents = dir_leaf(dd, leaf, 0);
+        dir_leaf_t *lh = (dir_leaf_t *)ents;
+        if (lh->count < DIR_LEAF_SLOTS - 1)
+        {
+            // create a new directory entry in the first free slot of the leaf
+            for (int ii = 1; ii < DIR_LEAF_SLOTS; ii++)
+            {
+                if (ents[ii].name[0] == '\0')
+                {
+                    memset(&ents[ii], 0, sizeof(dirent_t));
+                    strcpy(ents[ii].name, name);
+                    ents[ii].inum = inum;
+                    ents[ii].hash = hash;
+                    lh->count += 1;
+                    dd->size += 1; // update size in directory node
+                    return 0;
+                }
+            }
+        }
+        // the leaf is full, split it and try again
+        if (dir_split(dd, hd, leaf) != 0)
+        {
+            return -1;
+        }
+    }
 }
 
 // delete the file system object with the given name
@@ -99,34 +304,114 @@ int directory_delete(inode_t *dd, const char *name)
     {
         name++;
     }
-    dirent_t *base = (dirent_t *)blocks_get_block(dd->block);
-    dirent_t *dir;
-    int deleted = -1;
-    // for each entry in the inode, check if the name matches the given name
-    for (int i = 0; i < dd->size; i++)
+    dirent_t *slots;
+    dirent_t *dir = dir_find(dd, name, &slots);
+    if (dir == NULL)
     {
-        dir = (dirent_t *)(base + i);
-        if (strcmp(dir->name, name) == 0)
+        return -1;
+    }
+    // the inode itself is freed by unlink, and is still in use after a rename
+    memset(dir, 0, sizeof(dirent_t));
+    ((dir_leaf_t *)slots)->count -= 1;
+    dd->size -= 1; // update size of the directory
+    return 0;
+}
+
+// reverse the bits of a hash, so the hashes a leaf holds (which share their
+// low bits) form one contiguous range of the result
+// Args: hash of a name
+// Return: the hash with its bits reversed
+static uint32_t dir_rev(uint32_t hash)
+{
+    hash = (hash >> 16) | (hash << 16);
+    hash = ((hash & 0xff00ff00u) >> 8) | ((hash & 0x00ff00ffu) << 8);
+    hash = ((hash & 0xf0f0f0f0u) >> 4) | ((hash & 0x0f0f0f0fu) << 4);
+    hash = ((hash & 0xccccccccu) >> 2) | ((hash & 0x33333333u) << 2);
+    hash = ((hash & 0xaaaaaaaau) >> 1) | ((hash & 0x55555555u) << 1);
+    return hash;
+}
+
+// count the entries of a leaf that share an entry's hash and sort before it by name
+// Args: slots of the leaf, and one of its entries
+// Return: rank of the entry among the ones with its hash
+static int dir_rank(dirent_t *ents, dirent_t *dir)
+{
+    int rank = 0;
+    for (int ii = 1; ii < DIR_LEAF_SLOTS; ii++)
+    {
+        if (ents[ii].name[0] != '\0' && ents[ii].hash == dir->hash && strcmp(ents[ii].name, dir->name) < 0)
         {
-            // if matches and is not the most recent entry,
-            // overwrite with directory from the last slot
-            if (dd->size - 1 != i)
+            rank++;
+        }
+    }
+    return rank;
+}
+
+// pack a listing position: the reversed hash to continue from, and how many
+// entries with exactly that hash were already listed (they go in name order)
+// Positions 0 and 1 both start a listing, so readdir can use 1 for its own ".".
+// Args: reversed hash, and number of entries with it already listed
+// Return: the position
+static long dir_pos(uint64_t key, int skip)
+{
+    return 2 + (long)(key << 8 | skip);
+}
+
+// get the next entry of a directory listing
+// Entries are listed in order of their reversed hash, which a split never
+// changes, so a listing in progress neither repeats nor skips an entry that
+// stays in the directory however many entries are added or removed.
+// Args: directory node, and the position to continue from (0 to start),
+//       which is moved past the returned entry
+// Return: pointer to the entry, or NULL at the end of the directory
+dirent_t *directory_entry(inode_t *dd, long *pos)
+{
+    dir_header_t *hd = dir_header(dd, 0);
+    if (hd == NULL || hd->leaves == 0)
+    {
+        return NULL;
+    }
+    uint64_t key = *pos < 2 ? 0 : (uint64_t)(*pos - 2) >> 8;
+    int skip = *pos < 2 ? 0 : (*pos - 2) & 0xff;
+
+    while (key <= UINT32_MAX)
+    {
+        // the leaf holding the key covers every key with the same top depth bits
+        dirent_t *ents = dir_leaf(dd, dir_leaf_of(dd, hd, dir_rev(key)), 0);
+        int depth = ((dir_leaf_t *)ents)->depth;
+
+        // find the smallest entry at or after the position
+        dirent_t *next = NULL;
+        for (int ii = 1; ii < DIR_LEAF_SLOTS; ii++)
+        {
+            if (ents[ii].name[0] == '\0')
+            {
+                continue;
+            }
+            uint32_t kk = dir_rev(ents[ii].hash);
+            if (kk < key || (kk == key && dir_rank(ents, &ents[ii]) < skip))
             {
-                deleted = dir->inum;
-                memcpy(dir, base + dd->size - 1, sizeof(dirent_t));
+                continue;
             }
-            memset(base + dd->size - 1, 0, sizeof(dirent_t));
-            // we only have to decrement the size because if it's the most recent entry, it wont get checked by other
-            // functions and will get overwritten when another entry is put in
-            dd->size -= 1; // update size of the directory
-            if (deleted > 0)
+            if (next == NULL || kk < dir_rev(next->hash) ||
+                (kk == dir_rev(next->hash) && strcmp(ents[ii].name, next->name) < 0))
             {
-                free_inode(deleted); // free the deleted inode
+                next = &ents[ii];
             }
-            return 0;
         }
+        if (next != NULL)
+        {
+            uint32_t kk = dir_rev(next->hash);
+            *pos = dir_pos(kk, (kk == key ? skip : 0) + 1);
+            return next;
+        }
+
+        // nothing left in this leaf, continue with the first key past its range
+        key = ((key >> (32 - depth)) + 1) << (32 - depth);
+        skip = 0;
     }
-    return -1;
+    *pos = dir_pos(key, 0);
+    return NULL;
 }
 
 // list all the entries in the given directory path
@@ -134,15 +419,16 @@ int directory_delete(inode_t *dd, const char *name)
 // Return list on success
 slist_t *directory_list(const char *path)
 {
-    // Get the data block of the given path
     inode_t *node = get_inode(tree_lookup(path));
-    dirent_t *base = (dirent_t *)blocks_get_block(node->block);
+    slist_t *list = NULL;
+    if (node == NULL)
+    {
+        return list;
+    }
+    long pos = 0;
     dirent_t *dir;
-
-    slist_t *list;
-    for (int i = 0; i < node->size; i++)
+    while ((dir = directory_entry(node, &pos)) != NULL)
     {
-        dir = (dirent_t *)(base + i);
         list = s_cons(dir->name, list);
     }
     return list;
@@ -153,9 +439,10 @@ slist_t *directory_list(const char *path)
 // Return: printed statement
 void print_directory(inode_t *dd)
 {
-    dirent_t *dir = (dirent_t *)blocks_get_block(dd->block);
-    for (int i = 1; i < dd->size; i++)
+    long pos = 0;
+    dirent_t *dir;
+    while ((dir = directory_entry(dd, &pos)) != NULL)
     {
-        printf("directory name: %s\ndirectory inum: %d\ndirectory size: %d\n", dir->name, dir->inum, dir->size);
+        printf("directory name: %s\ndirectory inum: %d\ndirectory hash: %08x\n", dir->name, dir->inum, dir->hash);
     }
 }
@@ -4,10 +4,25 @@
 
 // based on cs3650 starter code
 
+// Directories are extendible hash tables over the blocks of the directory
+// inode. File block 0 starts with a dir_header_t followed by the index, an
+// array of 1 << depth leaf numbers addressed by the low bits of a name's
+// hash. Leaf k lives in file block DIR_LEAF_START + k and holds up to
+// DIR_LEAF_SLOTS - 1 entries after its dir_leaf_t header. A full leaf is
+// split in two, doubling the index first if needed, so lookups touch one
+// index entry and one leaf however large the directory gets. Listings go in
+// order of the bit-reversed hash, in which every leaf holds one range, so
+// the position of a listing stays valid across splits.
+
 #ifndef DIRECTORY_H
 #define DIRECTORY_H
 
 #define DIR_NAME_LENGTH 48
+#define DIR_LEAF_SLOTS 64  // dirent_t slots per leaf block, slot 0 holds the leaf header
+#define DIR_MAX_DEPTH 14   // largest index is 1 << 14 leaves (about 1M entries)
+#define DIR_LEAF_START 17  // file block of leaf 0, past the header and the largest index
+
+#include <stdint.h>
 
 #include "blocks.h"
 #include "inode.h"
@@ -19,14 +34,30 @@ typedef struct diren
   char name[DIR_NAME_LENGTH]; // name of the entry
   int inum;                   // index of the inode
   int size;                   // number of entries at this directory
-  char _reserved[8];          // padding to make this struct 64 bytes
+  uint32_t hash;              // hash of the name
+  char _reserved[4];          // padding to make this struct 64 bytes
 } dirent_t;
 
+typedef struct dir_header
+{
+  int depth;          // hash bits the index uses
+  int leaves;         // number of leaf blocks, 0 until the first entry
+  char _reserved[8];  // padding to keep the index aligned
+} dir_header_t;
+
+typedef struct dir_leaf
+{
+  int count;          // entries in use
+  int depth;          // low hash bits shared by every entry in this leaf
+  char _reserved[56]; // padding to make this struct the size of a dirent_t
+} dir_leaf_t;
+
 void directory_init();
 int directory_lookup(inode_t *dd, const char *name);
 int tree_lookup(const char *path);
 int directory_put(inode_t *dd, const char *name, int inum);
 int directory_delete(inode_t *dd, const char *name);
+dirent_t *directory_entry(inode_t *dd, long *pos);
 slist_t *directory_list(const char *path);
 void print_directory(inode_t *dd);
 
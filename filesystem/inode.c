@@ -1,14 +1,23 @@
+#include <string.h>
 #include "inode.h"
 #include "bitmap.h"
 #include "blocks.h"
 #include <sys/stat.h>
 
+static int inode_hint = 0; // where the next inode allocation starts looking
+
 // Print the attributes of the given node
 // Args: inode to print
 // Return: printed inode attributes
 void print_inode(inode_t *node)
 {
-    printf("inode refs: %d\ninode mode: %d\ninode size: %d\ninode block: %d\ninode inum: %d\n", node->refs, node->mode, node->size, node->block, node->inum);
+    printf("inode refs: %d\ninode mode: %d\ninode size: %d\ninode inum: %d\n", node->refs, node->mode, node->size, node->inum);
+    printf("inode blocks:");
+    for (int ii = 0; ii < INODE_DIRECT; ++ii)
+    {
+        printf(" %d", node->blocks[ii]);
+    }
+    printf("\ninode indirect: %d\ninode double indirect: %d\n", node->indirect, node->double_indirect);
 }
 
 // Get the inode at the given index
@@ -21,7 +30,7 @@ inode_t *get_inode(int inum)
         return NULL;
     }
     // Get inode table block and increment pointer by size of inodes until given inum
-    inode_t *nodes = get_inode_bitmap() + BLOCK_BITMAP_SIZE;
+    inode_t *nodes = blocks_get_block(get_superblock()->inode_table_start);
     return &nodes[inum];
 }
 
@@ -31,26 +40,35 @@ int alloc_inode()
     // Return a pointer to the beginning of the inode table bitmap
     void *ibm = get_inode_bitmap();
 
-    // Iterate through inode table bitmap until free inode
-    for (int ii = 0; ii < BLOCK_COUNT; ++ii)
+    // Find the next free inode in the inode table bitmap, wrapping around to the start
+    superblock_t *sb = get_superblock();
+    if (sb->free_inodes == 0)
     {
-        if (!bitmap_get(ibm, ii))
-        {
-            // Initialize a new inode
-            inode_t *inode = get_inode(ii);
-            inode->refs = 1;
-            inode->mode = S_IFDIR;
-            inode->size = 0;
-            inode->block = alloc_block();
-            inode->inum = ii;
-
-            // Set the corresponding bit in the bitmap to 1 (not free)
-            bitmap_put(ibm, ii, 1);
-            printf("+ alloc_inode() -> %d\n", ii);
-            return ii;
-        }
+        return -1;
     }
-    return -1;
+    int ii = bitmap_find_free(ibm, inode_hint, sb->inode_count);
+    if (ii == -1)
+    {
+        ii = bitmap_find_free(ibm, 0, inode_hint);
+    }
+    if (ii == -1)
+    {
+        return -1;
+    }
+
+    // Initialize a new inode, data blocks are allocated as it grows
+    inode_t *inode = get_inode(ii);
+    memset(inode, 0, sizeof(inode_t));
+    inode->refs = 1;
+    inode->mode = S_IFDIR;
+    inode->inum = ii;
+
+    // Set the corresponding bit in the bitmap to 1 (not free)
+    bitmap_put(ibm, ii, 1);
+    sb->free_inodes -= 1;
+    inode_hint = ii + 1;
+    printf("+ alloc_inode() -> %d\n", ii);
+    return ii;
 }
 
 // Deallocate the inode with the given index
@@ -58,12 +76,196 @@ int alloc_inode()
 void free_inode(int inum)
 {
     printf("+ free_inode(%d)\n", inum);
-    // Free the associated data block
+    // Free the associated data blocks
     inode_t *node = get_inode(inum);
-    free_block(node->block);
+    shrink_inode(node, 0);
 
     // Set the bit to 0, or free
     void *ibm = get_inode_bitmap();
-    bitmap_put(ibm, inum, 0);
+    if (bitmap_get(ibm, inum))
+    {
+        bitmap_put(ibm, inum, 0);
+        get_superblock()->free_inodes += 1;
+    }
+}
+
+// Follow a block pointer, allocating the block first if it is missing
+// Args: pointer to the block pointer, and whether to allocate a missing block
+// Return: block number, 0 for a missing block, or -1 if the disk is full
+static int block_slot(int *slot, int alloc)
+{
+    if (*slot == 0 && alloc)
+    {
+        int bnum = alloc_block();
+        if (bnum == -1)
+        {
+            return -1;
+        }
+        *slot = bnum;
+    }
+    return *slot;
+}
+
+// Find the block pointer for the given block of a file
+// Args: inode of the file, index of the block within the file, and whether to
+//       allocate the indirect blocks on the way if they are missing
+// Return: pointer to the block pointer, or NULL if an indirect block is missing
+//         (or the disk is full) or the file would grow past the double indirect block
+static int *inode_slot(inode_t *node, int file_bnum, int alloc)
+{
+    if (file_bnum < INODE_DIRECT)
+    {
+        return &node->blocks[file_bnum];
+    }
+    file_bnum -= INODE_DIRECT;
+
+    if (file_bnum < INODE_PTRS_PER_BLOCK)
+    {
+        int ind = block_slot(&node->indirect, alloc);
+        if (ind <= 0)
+        {
+            return NULL;
+        }
+        int *ptrs = blocks_get_block(ind);
+        return &ptrs[file_bnum];
+    }
+    file_bnum -= INODE_PTRS_PER_BLOCK;
+
+    if (file_bnum >= INODE_PTRS_PER_BLOCK * INODE_PTRS_PER_BLOCK)
+    {
+        return NULL;
+    }
+    int dind = block_slot(&node->double_indirect, alloc);
+    if (dind <= 0)
+    {
+        return NULL;
+    }
+    int *outer = blocks_get_block(dind);
+    int ind = block_slot(&outer[file_bnum / INODE_PTRS_PER_BLOCK], alloc);
+    if (ind <= 0)
+    {
+        return NULL;
+    }
+    int *ptrs = blocks_get_block(ind);
+    return &ptrs[file_bnum % INODE_PTRS_PER_BLOCK];
+}
+
+// Get the disk block holding the given block of a file
+// Args: inode of the file, index of the block within the file, and whether to
+//       allocate the block (and any indirect blocks on the way) if it is missing
+// Return: block number, 0 for a hole, or -1 if the disk is full or the file
+//         would grow past the double indirect block
+int inode_get_bnum(inode_t *node, int file_bnum, int alloc)
+{
+    int *slot = inode_slot(node, file_bnum, alloc);
+    if (slot == NULL)
+    {
+        return alloc ? -1 : 0;
+    }
+    return block_slot(slot, alloc);
+}
+
+// Allocate the missing blocks in a range of a file as one contiguous run
+// Args: inode of the file, index of the first block of the range, and number of blocks
+// Return: -1 if there is no free run that long (nothing is allocated then), 0 on success
+int inode_alloc_range(inode_t *node, int file_bnum, int count)
+{
+    int missing = 0;
+    for (int ii = 0; ii < count; ++ii)
+    {
+        int *slot = inode_slot(node, file_bnum + ii, 0);
+        if (slot == NULL || *slot == 0)
+        {
+            missing++;
+        }
+    }
+    if (missing == 0)
+    {
+        return 0;
+    }
+    int run = alloc_run(missing);
+    if (run == -1)
+    {
+        return -1;
+    }
+    printf("+ alloc_run(%d) -> %d\n", missing, run);
+
+    // hand out the run in file order, indirect blocks come from outside it
+    int next = run;
+    for (int ii = 0; ii < count && next < run + missing; ++ii)
+    {
+        int *slot = inode_slot(node, file_bnum + ii, 1);
+        if (slot == NULL)
+        {
+            break;
+        }
+        if (*slot == 0)
+        {
+            *slot = next++;
+        }
+    }
+    // give back whatever could not be placed
+    while (next < run + missing)
+    {
+        free_block(next++);
+    }
+    return 0;
+}
+
+// Free the blocks under a block pointer that hold file blocks past the ones kept
+// Args: pointer to the block pointer, levels of indirect blocks under it
+//       (0 for a data block), index of the first file block it covers, and
+//       number of file blocks to keep
+static void free_tree(int *slot, int depth, int first, int keep)
+{
+    int span = 1;
+    for (int ii = 0; ii < depth; ++ii)
+    {
+        span *= INODE_PTRS_PER_BLOCK;
+    }
+    if (*slot == 0 || first + span <= keep)
+    {
+        return;
+    }
+
+    if (depth > 0)
+    {
+        int *ptrs = blocks_get_block(*slot);
+        int child_span = span / INODE_PTRS_PER_BLOCK;
+        for (int ii = 0; ii < INODE_PTRS_PER_BLOCK; ++ii)
+        {
+            free_tree(&ptrs[ii], depth - 1, first + ii * child_span, keep);
+        }
+    }
+    // an indirect block is only freed once nothing under it is kept
+    if (first >= keep)
+    {
+        free_block(*slot);
+        *slot = 0;
+    }
 }
 
+// Shrink a file to the given size, freeing the blocks past its end
+// Args: inode of the file, and its new size in bytes
+void shrink_inode(inode_t *node, int size)
+{
+    int keep = bytes_to_blocks(size);
+    for (int ii = 0; ii < INODE_DIRECT; ++ii)
+    {
+        free_tree(&node->blocks[ii], 0, ii, keep);
+    }
+    free_tree(&node->indirect, 1, INODE_DIRECT, keep);
+    free_tree(&node->double_indirect, 2, INODE_DIRECT + INODE_PTRS_PER_BLOCK, keep);
+
+    // clear the rest of the last block, so the file reads back zeros if it grows again
+    int tail = size % BLOCK_SIZE;
+    if (tail != 0)
+    {
+        int bnum = inode_get_bnum(node, size / BLOCK_SIZE, 0);
+        if (bnum > 0)
+        {
+            memset(blocks_get_block(bnum) + tail, 0, BLOCK_SIZE - tail);
+        }
+    }
+    node->size = size;
+}
@@ -7,19 +7,33 @@
 #ifndef INODE_H
 #define INODE_H
 
+#include <limits.h>
+
 #include "blocks.h"
 
+#define INODE_DIRECT 10       // direct block pointers per inode
+#define INODE_PTRS_PER_BLOCK 1024 // block pointers in an indirect block (BLOCK_SIZE / sizeof(int))
+#define INODE_MAX_SIZE INT_MAX    // largest file in bytes, below the ~4.3 GB the block pointers reach
+
+// Blocks of a file are found through the direct pointers first, then through
+// the single indirect block, then through the double indirect block. Block 0
+// always holds the bitmaps, so a pointer of 0 means "no block" (a hole).
 typedef struct inode {
   int refs;  // reference count
   int mode;  // permission & type
-  int size;  // bytes
-  int block; // single block pointer (if max file size <= 4K)
+  int size;  // bytes, at most INODE_MAX_SIZE
   int inum; // index in the inode table
+  int blocks[INODE_DIRECT]; // direct block pointers
+  int indirect;             // block of INODE_PTRS_PER_BLOCK block pointers
+  int double_indirect;      // block of pointers to indirect blocks
 } inode_t;
 
 void print_inode(inode_t *node);
 inode_t *get_inode(int inum);
 int alloc_inode();
 void free_inode(int inum);
+int inode_get_bnum(inode_t *node, int file_bnum, int alloc);
+int inode_alloc_range(inode_t *node, int file_bnum, int count);
+void shrink_inode(inode_t *node, int size);
 
 #endif
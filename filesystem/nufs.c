@@ -5,6 +5,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -54,46 +55,35 @@ int nufs_getattr(const char *path, struct stat *st)
 }
 
 // implementation for: man 2 readdir
-// lists the contents of a directory
+// lists the contents of a directory, continuing from the given offset
 // Return -ENOENT on failure, 0 on success
 int nufs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi)
 {
-  struct stat st;
-  int rv;
-
-  rv = nufs_getattr(path, &st);
-  assert(rv == 0);
-  filler(buf, ".", &st, 0);
-
-  slist_t *list_head = directory_list(path);
-  slist_t *list = list_head;
-  // iterate through the contents of the directory and get the attributes of each
-  while (list)
+  if (storage_readdir(path, buf, filler, offset, fi) != 0)
+  {
+    printf("failed readdir(%s, @+%ld) -> %d\n", path, offset, -1);
+    return -ENOENT;
+  }
+  else
   {
-    char new_path[100];
-    strncpy(new_path, path, strlen(path));
-    strncat(new_path, list->data, DIR_NAME_LENGTH);
-    nufs_getattr(new_path, &st);
-    filler(buf, list->data, &st, 0);
-    list = list->next;
+    printf("readdir(%s, @+%ld) -> %d\n", path, offset, 0);
+    return 0;
   }
-  s_free(list_head);
-  s_free(list);
-  printf("readdir(%s) -> %d\n", path, rv);
-  return 0;
 }
 
 // mknod makes a filesystem object like a file or directory
 // called for: man 2 open, man 2 link
 // Note, for this assignment, you can alternatively implement the create function.
 // Args: file path to create, mode to set new file to
-// Return -ENOENT on failure, 0 on success
+// Return -ENAMETOOLONG if the path or the name is too long, -ENOSPC if there are
+//        no free inodes or the directory cannot grow, -ENOENT on other failures, 0 on success
 int nufs_mknod(const char *path, mode_t mode, dev_t rdev)
 {
-  if (storage_mknod(path, mode, 0) != 0)
+  int rv = storage_mknod(path, mode, 0);
+  if (rv != 0)
   {
-    printf("failed mknod(%s, %04o) -> %d\n", path, mode, -1);
-    return -ENOENT;
+    printf("failed mknod(%s, %04o) -> %d\n", path, mode, rv);
+    return rv == -1 ? -ENOENT : rv;
   }
   else
   {
@@ -105,13 +95,15 @@ int nufs_mknod(const char *path, mode_t mode, dev_t rdev)
 // most of the following callbacks implement
 // another system call; see section 2 of the manual
 // Args: path of directory to create and mode to set it to
-// Return -ENOENT on failure, 0 on success
+// Return -ENAMETOOLONG if the path or the name is too long, -ENOSPC if there are
+//        no free inodes or the directory cannot grow, -ENOENT on other failures, 0 on success
 int nufs_mkdir(const char *path, mode_t mode)
 {
-  if (storage_mknod(path, mode | 040000, 1) != 0)
+  int rv = storage_mknod(path, mode | 040000, 1);
+  if (rv != 0)
   {
-    printf("failed mkdir(%s) -> %d\n", path, -1);
-    return -ENOENT;
+    printf("failed mkdir(%s) -> %d\n", path, rv);
+    return rv == -1 ? -ENOENT : rv;
   }
   else
   {
@@ -122,13 +114,14 @@ int nufs_mkdir(const char *path, mode_t mode)
 
 // remove the filesystem object at the given path
 // Args: path to unlink
-// Return -ENOENT on failure, 0 on success
+// Return -ENAMETOOLONG if the path is too long, -ENOENT on other failures, 0 on success
 int nufs_unlink(const char *path)
 {
-  if (storage_unlink(path) != 0)
+  int rv = storage_unlink(path);
+  if (rv != 0)
   {
-    printf("failed rmdir(%s) -> %d\n", path, -1);
-    return -ENOENT;
+    printf("failed rmdir(%s) -> %d\n", path, rv);
+    return rv == -1 ? -ENOENT : rv;
   }
   else
   {
@@ -139,13 +132,14 @@ int nufs_unlink(const char *path)
 
 // Remove the directory at the given path
 // Args: file path of directory to remove
-// Return -ENOENT on failure, 0 on success
+// Return the error of nufs_unlink on failure, 0 on success
 int nufs_rmdir(const char *path)
 {
-  if (nufs_unlink(path) != 0)
+  int rv = nufs_unlink(path);
+  if (rv != 0)
   {
-    printf("failed rmdir(%s) -> %d\n", path, -1);
-    return -ENOENT;
+    printf("failed rmdir(%s) -> %d\n", path, rv);
+    return rv;
   }
   else
   {
@@ -157,13 +151,15 @@ int nufs_rmdir(const char *path)
 // implements: man 2 rename
 // called to move a file within the same filesystem
 // Args: file name to rename, and name to rename the file to
-// Return -ENOENT on failure, 0 on success
+// Return -ENAMETOOLONG if a path or the new name is too long, -ENOSPC if the new
+//        directory cannot grow, -ENOENT on other failures, 0 on success
 int nufs_rename(const char *from, const char *to)
 {
-  if (storage_rename(from, to) != 0)
+  int rv = storage_rename(from, to);
+  if (rv != 0)
   {
-    printf("failed to rename(%s => %s) -> %d\n", from, to, -1);
-    return -ENOENT;
+    printf("failed to rename(%s => %s) -> %d\n", from, to, rv);
+    return rv == -1 ? -ENOENT : rv;
   }
   else
   {
@@ -191,13 +187,14 @@ int nufs_chmod(const char *path, mode_t mode)
 
 // Truncate, or reduce the size, of the given file
 // Args: file path to truncate, and size to truncate it to
-// Return -ENOENT on failure, 0 on success
+// Return -EFBIG if the size is too large, -ENOENT on other failures, 0 on success
 int nufs_truncate(const char *path, off_t size)
 {
-  if (storage_truncate(path, size) != 0)
+  int rv = storage_truncate(path, size);
+  if (rv != 0)
   {
-    printf("failed to truncate(%s, %ld bytes) -> %d\n", path, size, -1);
-    return -ENOENT;
+    printf("failed to truncate(%s, %ld bytes) -> %d\n", path, size, rv);
+    return rv == -EFBIG ? -EFBIG : -ENOENT;
   }
   else
   {
@@ -238,14 +235,15 @@ int nufs_read(const char *path, char *buf, size_t size, off_t offset, struct fus
 
 // Actually write data to the file at the given path
 // Args: path of file to write, buffer to write, size of bytes to write, offset
-// Return -ENOENT on failure, 0 on success
+// Return -EFBIG if the file would grow too large, -ENOENT on other failures,
+//        number of bytes written on success
 int nufs_write(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
 {
   int rv = storage_write(path, buf, size, offset);
-  if (rv == -1)
+  if (rv < 0)
   {
     printf("failed to write(%s, %ld bytes, @+%ld) -> %d\n", path, size, offset, rv);
-    return -ENOENT;
+    return rv == -EFBIG ? -EFBIG : -ENOENT;
   }
   else
   {
@@ -254,6 +252,25 @@ int nufs_write(const char *path, const char *buf, size_t size, off_t offset, str
   }
 }
 
+// Report the size and free space of the file system
+// implementation for: man 2 statfs
+// Args: any path in the file system, struct statvfs to fill in
+// Return -ENOENT on failure, 0 on success
+int nufs_statfs(const char *path, struct statvfs *st)
+{
+  if (storage_statfs(path, st) != 0)
+  {
+    printf("failed statfs(%s) -> %d\n", path, -1);
+    return -ENOENT;
+  }
+  else
+  {
+    printf("statfs(%s) -> (%d) {blocks: %ld, free: %ld, files: %ld, free files: %ld}\n", path, 0,
+           st->f_blocks, st->f_bfree, st->f_files, st->f_ffree);
+    return 0;
+  }
+}
+
 // Link the node at the 'from' location to the 'to' location
 // Implementation was not necessary
 int nufs_link(const char *from, const char *to)
@@ -302,15 +319,60 @@ void nufs_init_ops(struct fuse_operations *ops)
   ops->open = nufs_open;
   ops->read = nufs_read;
   ops->write = nufs_write;
+  ops->statfs = nufs_statfs;
   ops->utimens = nufs_utimens;
   ops->ioctl = nufs_ioctl;
 };
 
 struct fuse_operations nufs_ops;
 
-// Mount and run the file system
+// Parse an image size like 512K, 64M or 10G
+// Args: size string, a number of bytes with an optional K, M or G suffix
+// Return the size in bytes, or -1 if it is malformed
+long parse_size(const char *text)
+{
+  char *end;
+  long size = strtol(text, &end, 10);
+  switch (*end)
+  {
+  case 'K':
+  case 'k':
+    size <<= 10;
+    end++;
+    break;
+  case 'M':
+  case 'm':
+    size <<= 20;
+    end++;
+    break;
+  case 'G':
+  case 'g':
+    size <<= 30;
+    end++;
+    break;
+  }
+  if (end == text || *end != '\0' || size <= 0)
+  {
+    return -1;
+  }
+  return size;
+}
+
+// Mount and run the file system, or create a new image with --mkfs
 int main(int argc, char *argv[])
 {
+  if (argc == 4 && strcmp(argv[1], "--mkfs") == 0)
+  {
+    long size = parse_size(argv[2]);
+    if (size == -1 || storage_mkfs(argv[3], size) != 0)
+    {
+      fprintf(stderr, "failed mkfs(%s, %s)\n", argv[3], argv[2]);
+      return 1;
+    }
+    printf("mkfs(%s, %ld bytes) -> %d\n", argv[3], size, 0);
+    return 0;
+  }
+
   assert(argc > 2 && argc < 6);
   printf("TODO: mount %s as data file\n", argv[--argc]);
   storage_init(argv[argc]);
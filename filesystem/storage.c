@@ -7,6 +7,8 @@
 #include <stdio.h>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
 #include <assert.h>
 #include <string.h>
 
@@ -16,37 +18,64 @@
 #include "inode.h"
 #include "blocks.h"
 #include "bitmap.h"
+#include "dcache.h"
+
+// Split a path into its parent directory and its last component
+// Args: path to split, and buffers of PATH_MAX bytes for the parent directory path and the name
+// Return: -ENAMETOOLONG if the path does not fit, 0 on success
+static int split_path(const char *path, char *parent, char *name)
+{
+    if (strlen(path) >= PATH_MAX)
+    {
+        return -ENAMETOOLONG;
+    }
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL || slash == path)
+    {
+        strcpy(parent, "/");
+    }
+    else
+    {
+        memcpy(parent, path, slash - path);
+        parent[slash - path] = '\0';
+    }
+    strcpy(name, slash == NULL ? path : slash + 1);
+    return 0;
+}
 
 // Initialize storage for the file at the given path
 // Args: path to initialize
 void storage_init(const char *path)
 {
-    // Load and initialize the given disk image, block 0 stores the block bitmap and the inode bitmap
+    // Load the given disk image, block 0 stores the superblock with its layout
     blocks_init(path);
-    // Initialize the root directory if it has not already been initialized
-    void *ibm = get_blocks_bitmap();
-    if (bitmap_get(ibm, 1) == 0)
+    // Initialize the root directory if the image is new (root is inode 0)
+    void *ibm = get_inode_bitmap();
+    if (bitmap_get(ibm, 0) == 0)
     {
         directory_init();
     }
 }
 
+// Create a new disk image with an empty root directory
+// Args: path of the image, and its size in bytes
+// Return: -1 on failure, 0 on success
+int storage_mkfs(const char *path, long size)
+{
+    if (blocks_format(path, size) != 0)
+    {
+        return -1;
+    }
+    storage_init(path);
+    blocks_free();
+    return 0;
+}
+
 // Get the inode's attributes
 // Args: path of the file to get its attributes, and struct to return those values
 // Return: -1 on failure, 0 on success
 int storage_stat(const char *path, struct stat *st)
 {
-    // Split the given path into the nested directory path and the target file system object
-    char nested_dir_path[100];
-    strcpy(nested_dir_path, path);
-    char *slash;
-    if (slash = strrchr(nested_dir_path, '/'))
-    {
-        *slash = '\0';
-    }
-    char nested_node[100] = "/";
-    strcpy(nested_node, (char *)(strrchr(path, '/')));
-    
     // Get the inode index at the given path, then get the inode pointer
     int inum = tree_lookup(path);
     inode_t *node = get_inode(inum);
@@ -65,28 +94,80 @@ int storage_stat(const char *path, struct stat *st)
     return 0;
 }
 
+// List a directory into the FUSE buffer, starting at the given offset
+// Each entry is passed with the offset of the next one, so FUSE can stop when its
+// buffer is full and call again from there.
+// Args: directory path, FUSE buffer and fill function, offset to continue from (0 to start), and file info
+// Return: -1 on failure, 0 on success
+int storage_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi)
+{
+    int inum = tree_lookup(path);
+    inode_t *node = get_inode(inum);
+    if (node == NULL || inum == -1 || !S_ISDIR(node->mode))
+    {
+        return -1;
+    }
+
+    struct stat st;
+    memset(&st, 0, sizeof(struct stat));
+    // only the root has "." stored as an entry, the listing continues from position 1
+    if (offset == 0 && directory_lookup(node, ".") == -1)
+    {
+        st.st_ino = inum;
+        st.st_mode = node->mode;
+        if (filler(buf, ".", &st, 1) != 0)
+        {
+            return 0;
+        }
+        offset = 1;
+    }
+
+    long next = offset;
+    dirent_t *dir;
+    while ((dir = directory_entry(node, &next)) != NULL)
+    {
+        // the attributes come straight from the inode, without a lookup per entry
+        inode_t *child = get_inode(dir->inum);
+        st.st_ino = child->inum;
+        st.st_mode = child->mode;
+        if (filler(buf, dir->name, &st, next) != 0)
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
 // make a filesystem object like a file or directory
 // Args: file path to create, mode to set new file at, and directory to place it in
-// Return: -1 on failure, 0 on success
+// Return: -1 on failure, -ENAMETOOLONG if the path or the name is too long,
+//         -ENOSPC if there are no free inodes or the directory cannot grow, 0 on success
 int storage_mknod(const char *path, int mode, int directory)
 {
-    // remove the first / from the path
-    char new_path[100];
-    strcpy(new_path, &path[1]);
-
     // split the path into the nested directory path and the target file system object
-    char nested_dir_path[100];
-    strcpy(nested_dir_path, path);
-    char *slash;
-    if (slash = strrchr(nested_dir_path, '/'))
+    char nested_dir_path[PATH_MAX];
+    char nested_node[PATH_MAX];
+    int rv = split_path(path, nested_dir_path, nested_node);
+    if (rv != 0)
     {
-        *slash = '\0';
+        return rv;
     }
-    char nested_node[100] = "/";
-    strcpy(nested_node, (char *)(strrchr(path, '/')) + 1);
-    
+    if (strlen(nested_node) >= DIR_NAME_LENGTH)
+    {
+        return -ENAMETOOLONG;
+    }
+    int dir_inum = tree_lookup(nested_dir_path);
+    if (dir_inum == -1)
+    {
+        return -1;
+    }
+
     // allocate a new inode and set to the given mode
     int inum = alloc_inode();
+    if (inum == -1)
+    {
+        return -ENOSPC;
+    }
     inode_t *inode = get_inode(inum);
     if (directory == 1)
     {
@@ -97,33 +178,30 @@ int storage_mknod(const char *path, int mode, int directory)
         inode->mode = 0100664;
     }
     
-    // add the new inode to the directory at the given path, starting from the root directory
-    if (strlen(nested_dir_path) == 0)
+    // add the new inode to its directory, the root when the path has no other slash
+    if (directory_put(get_inode(dir_inum), nested_node, inum) != 0)
     {
-	// If we are putting the node at the root directory
-        if (directory_put(get_inode(0), nested_node, inum) != 0)
-        {
-            return -1;
-        }
-    }
-    else
-    {
-	// If we are putting the node in a nested directory
-        int dir_inum = tree_lookup(nested_dir_path);
-        inode_t *nested_dir_inode = get_inode(dir_inum);
-        if (directory_put(nested_dir_inode, nested_node, inum) != 0)
-        {
-            return -1;
-        }
+        free_inode(inum);
+        return -ENOSPC;
     }
+    // replace a cached miss for the new path
+    dcache_put(path, inum);
     return 0;
 }
 
 // remove the file at the given path
 // Args: path of file to remove
-// Return: -1 on failure, 0 on success
+// Return: -1 on failure, -ENAMETOOLONG if the path is too long, 0 on success
 int storage_unlink(const char *path)
 {
+    char parent_path[PATH_MAX];
+    char filename[PATH_MAX];
+    int rv = split_path(path, parent_path, filename);
+    if (rv != 0)
+    {
+        return rv;
+    }
+
     // get the inode and free it
     int inum = tree_lookup(path);
     inode_t *node = get_inode(inum);
@@ -143,36 +221,11 @@ int storage_unlink(const char *path)
         }
     }
     free_inode(inum);
-
-    // remove the node from the directory
-    char parent_path[100] = "";
-    char filename[100] = "";
-    slist_t *list = s_explode(path, '/');
-    if (list->next && list->next->next)
-    {
-	// Iterate through the 'exploded' path
-        while (list->next)
-        {
-            int len = strlen(list->data);
-            if (len > 0)
-            {
-                strncat(parent_path, list->data, len);
-            }
-            list = list->next;
-            strcpy(filename, list->data);
-        }
-    }
-    else
-    {
-        strcpy(parent_path, "/");
-        strcpy(filename, path);
-    }
+    dcache_invalidate(path);
 
     // remove the node from the directory
     int dir_inum = tree_lookup(parent_path);
-    int dd = directory_delete(get_inode(dir_inum), filename);
-    s_free(list);
-    if (dd == -1)
+    if (dir_inum == -1 || directory_delete(get_inode(dir_inum), filename) == -1)
     {
         return -1;
     }
@@ -183,69 +236,60 @@ int storage_unlink(const char *path)
 // Rename the given file system object at the 'from' location to the 'to' location
 // Also used when moving files between directories
 // Args: file name to rename, and name to rename the file to
-// Return: -1 on failure, 0 on success
+// An existing file at the 'to' location is replaced.
+// Return: -1 on failure, -ENAMETOOLONG if a path or the new name is too long,
+//         -ENOSPC if the new directory cannot grow, 0 on success
 int storage_rename(const char *from, const char *to)
 {
-    char path[100] = "";     // the path of the directory the file is in
-    char to_path[100] = "";  // the path of the directory to be moved to
-    char filename[100] = ""; // the name of the file/directory being moved
-    // get the file directory to get the file from
-    slist_t *list = s_explode(from, '/');
-    if (list->next && list->next->next)
-    {
-	// Iterate through the 'exploded' path and 
-        while (list->next)
-        {
-            int len = strlen(list->data);
-            if (len > 0)
-            {
-                strncat(path, list->data, len);
-            }
-            list = list->next;
-        }
+    char path[PATH_MAX];      // the path of the directory the file is in
+    char from_name[PATH_MAX]; // the name of the file/directory being moved
+    char to_path[PATH_MAX];   // the path of the directory to be moved to
+    char filename[PATH_MAX];  // the new name of the file/directory
+    int rv = split_path(from, path, from_name);
+    if (rv == 0)
+    {
+        rv = split_path(to, to_path, filename);
     }
-    else
+    if (rv != 0)
     {
-        strcpy(path, "/");
+        return rv;
     }
 
-    s_free(list);
-
-    // get the to file directory to put into
-    slist_t *to_list = s_explode(to, '/');
-    if (to_list->next)
+    // search for the directory the file is in
+    int from_inum = tree_lookup(path);
+    int to_inum = tree_lookup(to_path);
+    int inum = tree_lookup(from);
+    if (from_inum == -1 || to_inum == -1 || inum == -1)
     {
-        while (to_list->next)
-        {
-            int len = strlen(to_list->data);
-            if (len > 0)
-            {
-                strncat(to_path, to_list->data, len);
-            }
-            to_list = to_list->next;
-        }
+        return -1;
     }
-    else
+    if (strlen(filename) >= DIR_NAME_LENGTH)
     {
-        strcpy(to_path, "/");
+        return -ENAMETOOLONG;
     }
-    strcpy(filename, to_list->data);
-    s_free(to_list);
-    
-    // search for the directory the file is in
-    int from_inum = tree_lookup(path);
-    int to_inum = tree_lookup(to_path);
-    if (from_inum == -1 || to_inum == -1)
+
+    // replace the file at the new path, which frees a slot in the leaf the new entry goes in
+    int old_inum = tree_lookup(to);
+    if (old_inum == inum)
+    {
+        return 0;
+    }
+    if (old_inum != -1 && storage_unlink(to) != 0)
     {
         return -1;
     }
-    inode_t *from_inode = get_inode(from_inum);
-    inode_t *to_inode = get_inode(to_inum);
 
-    // add the new path to the directory
-    directory_put(to_inode, filename, tree_lookup(from));
-    // remove the old path from the directory
-    directory_delete(from_inode, filename);
+    // add the new path to the directory, and only then remove the old one
+    if (directory_put(get_inode(to_inum), filename, inum) != 0)
+    {
+        return -ENOSPC;
+    }
+    directory_delete(get_inode(from_inum), from_name);
+
+    // everything cached under either path may now resolve differently
+    dcache_invalidate_tree(from);
+    dcache_invalidate_tree(to);
+    return 0;
 }
 
 // Change the permission mode for the given file
@@ -269,21 +313,30 @@ int storage_chmod(const char *path, mode_t mode)
 
 // Truncate, or reduce the size, of the given file
 // Args: file path to truncate, and the size the resulting file should be
-// Return: -1 on failure, 0 on success
+// Return: -1 on failure, -EFBIG if the size is past INODE_MAX_SIZE, 0 on success
 int storage_truncate(const char *path, off_t size)
 {
     // Get the inode index at the given path, then get the inode pointer
     int inum = tree_lookup(path);
     inode_t *node = get_inode(inum);
-    if (node == NULL || inum == -1)
+    if (node == NULL || inum == -1 || size < 0)
     {
         return -1;
     }
+    if (size > INODE_MAX_SIZE)
+    {
+        return -EFBIG;
+    }
+    // Shrinking frees the blocks past the new end, growing leaves a hole that reads as zeros
+    if (size < node->size)
+    {
+        shrink_inode(node, size);
+    }
     else
     {
         node->size = size;
-        return 0;
     }
+    return 0;
 }
 
 // Reads data into the buffer and returns number of characters read
@@ -298,48 +351,117 @@ int storage_read(const char *path, char *buf, size_t size, off_t offset)
     {
         return -1;
     }
-    // Get the pointer of the start of the corresponding data block, and increase by offset
-    void *start_addr = blocks_get_block(node->block);
-    start_addr += offset % BLOCK_SIZE;
+    // Only read up to the end of the file
+    if (offset >= node->size)
+    {
+        return 0;
+    }
+    if (size > (size_t)(node->size - offset))
+    {
+        size = node->size - offset;
+    }
+
+    // Copy the requested range one block at a time, holes read as zeros
+    size_t done = 0;
+    while (done < size)
+    {
+        off_t pos = offset + done;
+        size_t in_block = pos % BLOCK_SIZE;
+        size_t len = BLOCK_SIZE - in_block;
+        if (len > size - done)
+        {
+            len = size - done;
+        }
 
-    memcpy(buf, start_addr, node->size);
-    printf("printing buffer: \n %s \n", buf);
-    return strlen(buf);
+        int bnum = inode_get_bnum(node, pos / BLOCK_SIZE, 0);
+        if (bnum > 0)
+        {
+            memcpy(buf + done, blocks_get_block(bnum) + in_block, len);
+        }
+        else
+        {
+            memset(buf + done, 0, len);
+        }
+        done += len;
+    }
+    return size;
 }
 
 // Writes data from the buffer into memory
 // Args: path of file to write, buffer to write from, size of data to write, and offset
-// Return: -1 on failure, number of bytes written
+// Return: -1 on failure, -EFBIG if the file would grow past INODE_MAX_SIZE,
+//         number of bytes written on success
 int storage_write(const char *path, const char *buf, size_t size, off_t offset)
 {
     // Get the inode index at the given path, then get the inode pointer
     int inum = tree_lookup(path);
     inode_t *node = get_inode(inum);
-    if (node == NULL || inum == -1)
+    if (node == NULL || inum == -1 || offset < 0)
     {
         return -1;
     }
-    // Get the pointer of the start of the corresponding data block, and increase by offset
-    void *start_addr = blocks_get_block(node->block);
-    start_addr += offset % BLOCK_SIZE;
-    node->size = size; // update node size to # of bytes in the file
+    if (offset > INODE_MAX_SIZE || size > (size_t)(INODE_MAX_SIZE - offset))
+    {
+        return -EFBIG;
+    }
+
+    // Lay the new blocks of the write out next to each other if there is room
+    if (size > 0)
+    {
+        int first = offset / BLOCK_SIZE;
+        inode_alloc_range(node, first, (offset + size - 1) / BLOCK_SIZE - first + 1);
+    }
 
-    size_t len = strlen(buf);
-    // Ensure that the number of bytes written does not exceed the size of data
-    if (offset < size)
+    // Copy the data one block at a time, allocating any blocks still missing
+    size_t done = 0;
+    while (done < size)
     {
-        if (offset + size > len)
+        off_t pos = offset + done;
+        size_t in_block = pos % BLOCK_SIZE;
+        size_t len = BLOCK_SIZE - in_block;
+        if (len > size - done)
         {
-            size = len - offset;
+            len = size - done;
         }
 
-        memcpy(start_addr, buf, size);
-        char *written = (char *)start_addr;
-        printf("written text : \n %s \n", written);
+        int bnum = inode_get_bnum(node, pos / BLOCK_SIZE, 1);
+        if (bnum == -1)
+        {
+            // out of space, report what was written so far
+            break;
+        }
+        memcpy(blocks_get_block(bnum) + in_block, buf + done, len);
+        done += len;
     }
-    else
+
+    // update node size to # of bytes in the file
+    if (offset + (off_t)done > node->size)
     {
-        size = 0;
+        node->size = offset + done;
     }
-    return size;
+    if (done == 0 && size > 0)
+    {
+        return -1;
+    }
+    return done;
+}
+
+// Report the size and usage of the file system
+// Args: any path in the file system, and the struct to fill in
+// Return: 0 on success
+int storage_statfs(const char *path, struct statvfs *st)
+{
+    // the free counts are kept up to date on every allocation, so this does not scan
+    superblock_t *sb = get_superblock();
+    memset(st, 0, sizeof(struct statvfs));
+    st->f_bsize = BLOCK_SIZE;
+    st->f_frsize = BLOCK_SIZE;
+    st->f_blocks = sb->block_count;
+    st->f_bfree = sb->free_blocks;
+    st->f_bavail = sb->free_blocks;
+    st->f_files = sb->inode_count;
+    st->f_ffree = sb->free_inodes;
+    st->f_favail = sb->free_inodes;
+    st->f_namemax = DIR_NAME_LENGTH - 1;
+    return 0;
 }
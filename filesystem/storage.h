@@ -11,6 +11,7 @@
 #include <fuse.h>
 
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
@@ -18,6 +19,7 @@
 #include "slist.h"
 
 void storage_init(const char *path);
+int storage_mkfs(const char *path, long size);
 int storage_stat(const char *path, struct stat *st);
 int storage_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi);
 int storage_read(const char *path, char *buf, size_t size, off_t offset);
@@ -27,6 +29,7 @@ int storage_truncate(const char *path, off_t size);
 int storage_mknod(const char *path, int mode, int directory);
 int storage_unlink(const char *path);
 int storage_rename(const char *from, const char *to);
+int storage_statfs(const char *path, struct statvfs *st);
 slist_t *storage_list(const char *path);
 
 #endif
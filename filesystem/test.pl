@@ -2,7 +2,7 @@
 use 5.16.0;
 use warnings FATAL => 'all';
 
-use Test::Simple tests => 31;
+use Test::Simple tests => 57;
 use IO::Handle;
 
 sub mount {
@@ -171,5 +171,173 @@ ok(($listed and $exists and $has_size), "Larger file exists and has the correct
 $back = read_text("larger.txt");
 ok($content eq $back, "Read back data from larger file correctly");
 
-unmount()
+unmount();
+
+system("rm -f data.nufs test.log");
+
+mount();
+
+say "# Multi-MB files";
+
+$chunks = 256 * 1024; # 4 MB, past the direct and into the indirect blocks
+$content = "1_2_3_4_5_6_7_8_" x $chunks;
+write_text("huge.txt", $content);
+$size = -s "mnt/huge.txt";
+$size or $size = 0;
+say "# Actual size: $size";
+ok($size eq 16 * $chunks + 1, "Multi-MB file has the correct size");
+$back = read_text("huge.txt");
+ok($content eq $back, "Read back data from multi-MB file correctly");
+$back = read_text_slice("huge.txt", 16, 3 * 1024 * 1024 + 4096 - 8);
+ok($back eq "5_6_7_8_1_2_3_4_", "Read across a block boundary deep in the file");
+
+system("truncate -s 1000 mnt/huge.txt");
+$back = read_text("huge.txt");
+ok($back eq substr($content, 0, 1000), "Truncate a multi-MB file");
+
+open my $fh, "+<", "mnt/huge.txt";
+seek $fh, 100000, 0;
+print $fh "tail";
+close $fh;
+$back = read_text_slice("huge.txt", 8, 99996);
+ok($back eq "\0\0\0\0tail", "Writing past the end leaves a zero-filled hole");
+
+unmount();
+
+system("rm -f data.nufs test.log");
+
+say "# Configurable image size";
+
+system("./nufs --mkfs 2G data.nufs >> test.log");
+ok(-s "data.nufs" == 2 << 30, "mkfs creates an image of the requested size");
+
+mount();
+write_text("one.txt", $msg0);
+$msg1 = read_text("one.txt");
+ok($msg0 eq $msg1, "Read back data from a 2 GB image");
+
+# file sizes are an int, so the largest file is 2 GB - 1 byte whatever the image size
+open $fh, "+<", "mnt/one.txt";
+sysseek $fh, (2 << 30) - 5, 0;
+my $wrote = syswrite $fh, "tail";
+sysseek $fh, 3 << 30, 0;
+my $past = syswrite $fh, "tail";
+close $fh;
+ok(($wrote == 4 and -s "mnt/one.txt" == (2 << 30) - 1), "Write up to the largest file size");
+ok((!defined $past and -s "mnt/one.txt" == (2 << 30) - 1), "Write past the largest file size fails");
+system("truncate -s 5G mnt/one.txt 2>> test.log");
+ok(-s "mnt/one.txt" == (2 << 30) - 1, "Truncate past the largest file size fails");
+unmount();
+
+system("rm -f data.nufs test.log");
+
+mount();
+
+say "# Path lookups";
+
+ok((mkdir("mnt/a") and mkdir("mnt/a/b") and mkdir("mnt/a/b/c")), "Create a deep tree");
+ok(!-e "mnt/a/b/c/file.txt", "File does not exist yet");
+write_text("a/b/c/file.txt", $msg0);
+ok(-f "mnt/a/b/c/file.txt", "File exists after it was looked up and missed");
+system("mv mnt/a/b/c/file.txt mnt/a/b/c/renamed.txt");
+ok((!-e "mnt/a/b/c/file.txt" and read_text("a/b/c/renamed.txt") eq $msg0), "Rename a file within a directory");
+system("mv mnt/a/b mnt/moved");
+ok((!-e "mnt/a/b/c/renamed.txt" and -f "mnt/moved/c/renamed.txt"), "Rename a directory moves the paths under it");
+system("rm -f mnt/moved/c/renamed.txt");
+ok(!-e "mnt/moved/c/renamed.txt", "Unlink a file in a nested directory");
+
+my $deep = join("/", map { "level$_" } 1 .. 30);
+system("mkdir -p mnt/$deep");
+write_text("$deep/file.txt", $msg0);
+system("mv mnt/$deep/file.txt mnt/$deep/moved.txt");
+ok((read_text("$deep/moved.txt") eq $msg0 and unlink("mnt/$deep/moved.txt") and !-e "mnt/$deep/moved.txt"),
+   "Rename and unlink with paths longer than 200 bytes");
+
+my $toolong = "a_name_that_is_far_too_long_for_a_directory_entry";
+write_text("keep.txt", $msg0);
+ok((!rename("mnt/keep.txt", "mnt/$toolong") and read_text("keep.txt") eq $msg0),
+   "Rename to a name that is too long fails and keeps the file");
+write_text("old.txt", $msg0);
+write_text("new.txt", $msg2);
+ok((rename("mnt/old.txt", "mnt/new.txt") and !-e "mnt/old.txt" and read_text("new.txt") eq $msg0),
+   "Rename onto an existing file replaces it");
+
+unmount();
+
+system("rm -f data.nufs test.log");
+
+mount();
+
+say "# Large directories";
+
+mkdir("mnt/many");
+for my $i (1 .. 2000) {
+    write_text("many/file$i.txt", "entry $i");
+}
+my @entries = grep { /^file\d+\.txt$/ } split /\n/, `ls mnt/many`;
+ok(scalar(@entries) == 2000, "List a directory with 2000 entries");
+ok(read_text("many/file1234.txt") eq "entry 1234", "Read a file from a large directory");
+for my $i (1 .. 1000) {
+    unlink("mnt/many/file$i.txt");
+}
+@entries = grep { /^file\d+\.txt$/ } split /\n/, `ls mnt/many`;
+ok((scalar(@entries) == 1000 and !-e "mnt/many/file1.txt" and -e "mnt/many/file2000.txt"),
+   "Delete half of a large directory");
+
+unmount();
+
+system("rm -f data.nufs test.log");
+
+mount();
+
+# long names, so the kernel has to come back for more entries after the first read
+my $long = "entry_with_a_name_to_fill_the_buffer_";
+mkdir("mnt/listing");
+for my $i (1 .. 1500) {
+    write_text("listing/old_$long$i", "");
+}
+opendir my $dh, "mnt/listing";
+my %listed;
+$listed{readdir $dh}++ for 1 .. 100;
+for my $i (1 .. 1500) {
+    write_text("listing/new_$long$i", "");
+}
+$listed{$_}++ while defined($_ = readdir $dh);
+closedir $dh;
+my @repeated = grep { $listed{$_} > 1 } keys %listed;
+my @missed = grep { !$listed{"old_$long$_"} } 1 .. 1500;
+say "# Repeated: " . scalar(@repeated) . ", missed: " . scalar(@missed);
+ok((!@repeated and !@missed), "Create entries during a listing without repeating or missing any");
+
+unmount();
+
+system("rm -f data.nufs test.log");
+
+mount();
+
+say "# Free space";
 
+my ($total0, $free0) = (split ' ', `df -B4096 mnt | tail -1`)[1, 3];
+ok($total0 == 16384, "statfs reports the size of the image");
+write_text("mb.txt", "x" x (1 << 20));
+my $free1 = (split ' ', `df -B4096 mnt | tail -1`)[3];
+say "# Free blocks: $free0 -> $free1";
+ok($free0 - $free1 >= 256, "statfs free count drops as a file grows");
+
+unmount();
+
+system("rm -f data.nufs test.log");
+
+# a 1 MB image has 64 inodes, the root takes one
+system("./nufs --mkfs 1M data.nufs >> test.log");
+mount();
+my $created = 0;
+for my $i (1 .. 100) {
+    open my $out, ">", "mnt/f$i" or last;
+    close $out;
+    $created++;
+}
+say "# Created $created files";
+ok(($created == 63 and -f "mnt/f1" and !-e "mnt/f64"), "Creating files stops cleanly when inodes run out");
+
+unmount();
@@ -0,0 +1,392 @@
+/**
+ * Adaptive natural merge sort (powersort) for partially sorted input.
+ *
+ * The merge policy follows Munro and Wild's powersort as used by CPython:
+ * each boundary between two neighbouring runs gets a "power" from the
+ * positions of the runs' midpoints, and runs are merged while the boundary
+ * below the top of the stack is more powerful than the newest one.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "psort.h"
+#include "adaptive.h"
+#include "topology.h"
+#include "profile.h"
+
+// A run waiting on the merge stack
+typedef struct pending_run {
+  long start;
+  long len;
+  int power;   // power of the boundary between this run and the next one
+} pending_run;
+
+// Helper struct to pass custom arguments to pthread_create
+typedef struct chunk_args {
+  long *nums;
+  long *tmp;
+  long from;
+  long to;
+  long mid;    // merge jobs only
+  int slot;    // topology slot of the first chunk, where the data was sorted
+  int level;   // merge round, merge jobs only
+} chunk_args;
+
+
+/**
+ * Number of elements of run[0..n) that are <= key, found by galloping from
+ * the front.
+ */
+static long gallop_right(long key, const long *run, long n) {
+  long lo = 0;
+  long hi = 1;
+  while (hi <= n && run[hi - 1] <= key) {
+    lo = hi;
+    hi = 2 * hi + 1;
+  }
+  if (hi > n) {
+    hi = n;
+  }
+  // run[0..lo) <= key; search the rest of run[lo..hi)
+  while (lo < hi) {
+    long mid = lo + (hi - lo) / 2;
+    if (run[mid] <= key) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+
+/**
+ * Number of elements of run[0..n) that are < key, found by galloping from
+ * the front.
+ */
+static long gallop_left(long key, const long *run, long n) {
+  long lo = 0;
+  long hi = 1;
+  while (hi <= n && run[hi - 1] < key) {
+    lo = hi;
+    hi = 2 * hi + 1;
+  }
+  if (hi > n) {
+    hi = n;
+  }
+  while (lo < hi) {
+    long mid = lo + (hi - lo) / 2;
+    if (run[mid] < key) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+
+/**
+ * Merge the neighbouring sorted runs nums[from..mid) and nums[mid..to) in
+ * place, using tmp[from..mid) as scratch.
+ */
+static void merge_adjacent(long *nums, long *tmp, long from, long mid, long to) {
+  // the start of the left run and the end of the right run may already be
+  // in place
+  from += gallop_right(nums[mid], &nums[from], mid - from);
+  if (from == mid) {
+    return;
+  }
+  to = mid + gallop_left(nums[mid - 1], &nums[mid], to - mid);
+
+  long *a = &tmp[from];
+  long *a_end = a + (mid - from);
+  memcpy(a, &nums[from], (mid - from) * sizeof(long));
+  long *b = &nums[mid];
+  long *b_end = &nums[to];
+  long *dst = &nums[from];
+
+  while (a < a_end && b < b_end) {
+    // one element at a time until one side keeps winning
+    int a_wins = 0;
+    int b_wins = 0;
+    while (a < a_end && b < b_end) {
+      if (*b < *a) {
+        *dst++ = *b++;
+        b_wins++;
+        a_wins = 0;
+        if (b_wins >= ADAPTIVE_MIN_GALLOP) {
+          break;
+        }
+      }
+      else {
+        *dst++ = *a++;
+        a_wins++;
+        b_wins = 0;
+        if (a_wins >= ADAPTIVE_MIN_GALLOP) {
+          break;
+        }
+      }
+    }
+
+    // then copy whole stretches found by galloping
+    long ka = ADAPTIVE_MIN_GALLOP;
+    long kb = ADAPTIVE_MIN_GALLOP;
+    while (a < a_end && b < b_end &&
+           (ka >= ADAPTIVE_MIN_GALLOP || kb >= ADAPTIVE_MIN_GALLOP)) {
+      ka = gallop_right(*b, a, a_end - a);
+      memcpy(dst, a, ka * sizeof(long));
+      dst += ka;
+      a += ka;
+      if (a == a_end) {
+        break;
+      }
+      *dst++ = *b++;
+      if (b == b_end) {
+        break;
+      }
+
+      kb = gallop_left(*a, b, b_end - b);
+      memmove(dst, b, kb * sizeof(long));
+      dst += kb;
+      b += kb;
+      if (b == b_end) {
+        break;
+      }
+      *dst++ = *a++;
+    }
+  }
+
+  // what is left of the right run is already in place
+  memcpy(dst, a, (a_end - a) * sizeof(long));
+}
+
+
+/**
+ * Find the natural run starting at from, reversing it if it descends, and
+ * extend it to at least ADAPTIVE_MIN_RUN elements. Returns its length.
+ */
+static long next_run(long *nums, long from, long to) {
+  long end = from + 1;
+  if (end < to) {
+    if (nums[end] < nums[from]) {
+      // strictly descending, so reversing it keeps the sort stable
+      while (end < to && nums[end] < nums[end - 1]) {
+        end++;
+      }
+      for (long i = from, j = end - 1; i < j; i++, j--) {
+        long swap = nums[i];
+        nums[i] = nums[j];
+        nums[j] = swap;
+      }
+    }
+    else {
+      while (end < to && nums[end] >= nums[end - 1]) {
+        end++;
+      }
+    }
+  }
+
+  // binary insertion sort up to the minimum run length
+  long force = from + ADAPTIVE_MIN_RUN < to ? from + ADAPTIVE_MIN_RUN : to;
+  for (; end < force; end++) {
+    long x = nums[end];
+    long pos = from + gallop_right(x, &nums[from], end - from);
+    memmove(&nums[pos + 1], &nums[pos], (end - pos) * sizeof(long));
+    nums[pos] = x;
+  }
+  return end - from;
+}
+
+
+/**
+ * Power of the boundary between the neighbouring runs [s1, s1 + n1) and
+ * [s1 + n1, s1 + n1 + n2) of a range of n elements.
+ */
+static int node_power(long s1, long n1, long n2, long n) {
+  int power = 0;
+  long a = 2 * s1 + n1;    // twice the midpoint of the first run
+  long b = a + n1 + n2;    // twice the midpoint of the second run
+  for (;;) {
+    power++;
+    if (a >= n) {
+      a -= n;
+      b -= n;
+    }
+    else if (b >= n) {
+      break;
+    }
+    a <<= 1;
+    b <<= 1;
+  }
+  return power;
+}
+
+
+/**
+ * Powersort nums[from..to) in place with tmp[from..to) as scratch.
+ */
+static void powersort(long *nums, long *tmp, long from, long to) {
+  long n = to - from;
+  if (n < 2) {
+    return;
+  }
+
+  // the stack depth is bounded by the number of distinct powers
+  pending_run stack[130];
+  int depth = 0;
+
+  long start = from;
+  while (start < to) {
+    long len = next_run(nums, start, to);
+
+    if (depth > 0) {
+      pending_run *top = &stack[depth - 1];
+      int power = node_power(top->start - from, top->len, len, n);
+      while (depth > 1 && stack[depth - 2].power > power) {
+        pending_run *a = &stack[depth - 2];
+        pending_run *b = &stack[depth - 1];
+        merge_adjacent(nums, tmp, a->start, b->start, b->start + b->len);
+        a->len += b->len;
+        depth--;
+      }
+      stack[depth - 1].power = power;
+    }
+
+    stack[depth].start = start;
+    stack[depth].len = len;
+    stack[depth].power = 0;
+    depth++;
+    start += len;
+  }
+
+  while (depth > 1) {
+    pending_run *a = &stack[depth - 2];
+    pending_run *b = &stack[depth - 1];
+    merge_adjacent(nums, tmp, a->start, b->start, b->start + b->len);
+    a->len += b->len;
+    depth--;
+  }
+}
+
+
+static void *sort_chunk(void *arg) {
+  chunk_args *c = arg;
+  topo_pin(c->slot);
+  PROF_BEGIN(span, "powersort chunk", 0);
+  powersort(c->nums, c->tmp, c->from, c->to);
+  PROF_END(span, 2 * (c->to - c->from) * sizeof(long));
+  return NULL;
+}
+
+static void *merge_chunks(void *arg) {
+  chunk_args *c = arg;
+  topo_pin(c->slot);
+  if (c->mid > c->from && c->mid < c->to) {
+    PROF_BEGIN(span, "chunk merge", c->level);
+    merge_adjacent(c->nums, c->tmp, c->from, c->mid, c->to);
+    PROF_END(span, 2 * (c->to - c->from) * sizeof(long));
+  }
+  return NULL;
+}
+
+
+/**
+ * Run fn over jobs[0..n), one thread per job.
+ */
+static void run_jobs(void *(*fn)(void *), chunk_args *jobs, int n) {
+  pthread_t *tids = malloc(n * sizeof(pthread_t));
+  assert(tids != NULL);
+  for (int i = 1; i < n; i++) {
+    pthread_create(&tids[i], NULL, fn, &jobs[i]);
+  }
+  if (n > 0) {
+    fn(&jobs[0]);
+  }
+  for (int i = 1; i < n; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  free(tids);
+}
+
+
+/**
+ * Move a split point forward to the end of the natural run it falls in.
+ */
+static long run_boundary(const long *nums, long pos, long count) {
+  if (pos <= 0 || pos >= count) {
+    return pos;
+  }
+  if (nums[pos] >= nums[pos - 1]) {
+    while (pos < count && nums[pos] >= nums[pos - 1]) {
+      pos++;
+    }
+  }
+  else {
+    while (pos < count && nums[pos] < nums[pos - 1]) {
+      pos++;
+    }
+  }
+  return pos;
+}
+
+
+// Sort the given array with an adaptive natural merge sort.
+long *adaptive_sort(long nums[], long count, int threads) {
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  // sort in the result array, with the input as scratch
+  long *result = psort_alloc(count * sizeof(long), threads);
+  assert(result != NULL);
+  memcpy(result, nums, count * sizeof(long));
+
+  // chunk boundaries, moved forward so they never split a run
+  long *bounds = malloc((threads + 1) * sizeof(long));
+  assert(bounds != NULL);
+  int chunks = 0;
+  bounds[0] = 0;
+  for (int t = 1; t <= threads; t++) {
+    long b = t == threads ? count : run_boundary(result, count * t / threads, count);
+    if (b > bounds[chunks]) {
+      bounds[++chunks] = b;
+    }
+  }
+
+  chunk_args *jobs = malloc((chunks > 0 ? chunks : 1) * sizeof(chunk_args));
+  assert(jobs != NULL);
+  for (int i = 0; i < chunks; i++) {
+    jobs[i].nums = result;
+    jobs[i].tmp = nums;
+    jobs[i].from = bounds[i];
+    jobs[i].to = bounds[i + 1];
+    jobs[i].slot = i;
+  }
+  run_jobs(sort_chunk, jobs, chunks);
+
+  // merge neighbouring chunks pairwise until one is left
+  for (int width = 1, round = 1; width < chunks; width *= 2, round++) {
+    int n = 0;
+    for (int i = 0; i + width < chunks; i += 2 * width) {
+      int last = i + 2 * width < chunks ? i + 2 * width : chunks;
+      jobs[n].nums = result;
+      jobs[n].tmp = nums;
+      jobs[n].from = bounds[i];
+      jobs[n].mid = bounds[i + width];
+      jobs[n].to = bounds[last];
+      jobs[n].slot = i;
+      jobs[n].level = round;
+      n++;
+    }
+    run_jobs(merge_chunks, jobs, n);
+  }
+
+  free(bounds);
+  free(jobs);
+  return result;
+}
@@ -0,0 +1,32 @@
+/**
+ * Adaptive natural merge sort (powersort) for partially sorted input.
+ */
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+/** Natural runs shorter than this are extended by binary insertion sort. */
+#define ADAPTIVE_MIN_RUN 32
+
+/** Wins in a row after which a merge switches to galloping. */
+#define ADAPTIVE_MIN_GALLOP 7
+
+/**
+ * Sort the given array with an adaptive natural merge sort and return the
+ * sorted version.
+ *
+ * Existing ascending and strictly descending runs are detected (descending
+ * ones are reversed), short runs are extended to ADAPTIVE_MIN_RUN, and runs
+ * are merged in the order powersort prescribes, galloping through stretches
+ * that are already in place. Nearly sorted input takes close to linear time.
+ *
+ * The input is split into one chunk per thread, but every split point is
+ * moved forward to the end of the natural run it falls in, so runs are never
+ * cut in two. The sorted chunks are then merged pairwise.
+ *
+ * The result is malloc'd so it is the caller's responsibility to free it.
+ *
+ * Warning: The source array gets overwritten.
+ */
+long *adaptive_sort(long nums[], long count, int threads);
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * Sort-based aggregation: collapse sorted keys to distinct values and counts.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "aggregate.h"
+#include "sortio.h"
+#include "topology.h"
+
+// Helper struct to pass custom arguments to pthread_create
+typedef struct aggregate_args {
+  long *nums;
+  long *counts;
+  long from;
+  long to;
+  long distinct;
+  int id;
+} aggregate_args;
+
+
+// Collapse the runs of equal values in a sorted array in place.
+long aggregate_run(long *nums, long *counts, long count) {
+  long out = 0;
+  long i = 0;
+  while (i < count) {
+    long x = nums[i];
+    long j = i + 1;
+    while (j < count && nums[j] == x) {
+      j++;
+    }
+    nums[out] = x;
+    if (counts != NULL) {
+      counts[out] = j - i;
+    }
+    out++;
+    i = j;
+  }
+  return out;
+}
+
+
+/**
+ * Collapse one thread's slice of the array.
+ */
+static void *aggregate_worker(void *arg_in) {
+  aggregate_args *arg = arg_in;
+  topo_pin(arg->id);
+  arg->distinct = aggregate_run(&arg->nums[arg->from],
+                                arg->counts != NULL ? &arg->counts[arg->from] : NULL,
+                                arg->to - arg->from);
+  return NULL;
+}
+
+
+// Collapse the runs of a sorted array with every thread taking a slice.
+long aggregate_sorted(long *nums, long *counts, long count, int threads) {
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  aggregate_args *args = malloc(threads * sizeof(aggregate_args));
+  pthread_t *tids = malloc(threads * sizeof(pthread_t));
+  assert(args != NULL && tids != NULL);
+
+  // the calling thread works on the first slice
+  for (int t = 0; t < threads; t++) {
+    args[t].nums = nums;
+    args[t].counts = counts;
+    args[t].from = count * t / threads;
+    args[t].to = count * (t + 1) / threads;
+    args[t].id = t;
+  }
+  for (int t = 1; t < threads; t++) {
+    pthread_create(&tids[t], NULL, aggregate_worker, &args[t]);
+  }
+  aggregate_worker(&args[0]);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+
+  // move the slices together; a run that spans a boundary shows up as the
+  // first value of a slice repeating the last one kept so far
+  long out = 0;
+  for (int t = 0; t < threads; t++) {
+    long from = args[t].from;
+    long n = args[t].distinct;
+    if (n > 0 && out > 0 && nums[out - 1] == nums[from]) {
+      if (counts != NULL) {
+        counts[out - 1] += counts[from];
+      }
+      from++;
+      n--;
+    }
+    memmove(&nums[out], &nums[from], n * sizeof(long));
+    if (counts != NULL) {
+      memmove(&counts[out], &counts[from], n * sizeof(long));
+    }
+    out += n;
+  }
+
+  free(args);
+  free(tids);
+  return out;
+}
+
+
+// Print distinct values, with their counts in front in the format of uniq -c.
+void print_aggregated(const long *nums, const long *counts, long count) {
+  if (counts == NULL) {
+    print_long_array(nums, count);
+    return;
+  }
+  for (long i = 0; i < count; ++i) {
+    printf("%7ld %ld\n", counts[i], nums[i]);
+  }
+}
@@ -0,0 +1,38 @@
+/**
+ * Sort-based aggregation: collapse sorted keys to distinct values and counts.
+ */
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+/** What tmsort -u and -c reduce the sorted output to. */
+typedef enum aggregate {
+  AGGREGATE_NONE,
+  AGGREGATE_UNIQUE,   // every distinct value once
+  AGGREGATE_COUNT,    // every distinct value with its number of occurrences
+} aggregate_t;
+
+/**
+ * Collapse the runs of equal values in a sorted array in place.
+ *
+ * @param nums The sorted values; the distinct ones end up at the front.
+ * @param counts If not NULL, receives the length of each run, at the index
+ *               of its value.
+ * @param count Number of elements.
+ * @return The number of distinct values.
+ */
+long aggregate_run(long *nums, long *counts, long count);
+
+/**
+ * Like aggregate_run(), but every thread first collapses its own slice of
+ * the array and the slices are then stitched together, merging the runs
+ * that span a slice boundary.
+ */
+long aggregate_sorted(long *nums, long *counts, long count, int threads);
+
+/**
+ * Print distinct values, an element per line, with their counts in front if
+ * counts is not NULL, in the format of uniq -c.
+ */
+void print_aggregated(const long *nums, const long *counts, long count);
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * Engine selection for tmsort -e auto from a sample of the input.
+ */
+#include <stdlib.h>
+#include <assert.h>
+
+#include "autoselect.h"
+#include "kernels.h"
+
+
+/**
+ * Next value of a xorshift64* generator.
+ */
+static unsigned long next_random(unsigned long *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717UL;
+}
+
+
+/**
+ * Fraction of the adjacent pairs in the windows that break a run. Each
+ * window counts its ascending and descending steps and takes the smaller,
+ * so sorted and reverse sorted input both come out near 0.
+ */
+static double run_breaks(const long *nums, long count) {
+  long breaks = 0;
+  long pairs = 0;
+  for (long w = 0; w < AUTO_WINDOWS; w++) {
+    long from = (count - AUTO_WINDOW) / (AUTO_WINDOWS - 1) * w;
+    long up = 0;
+    long down = 0;
+    for (long i = from + 1; i < from + AUTO_WINDOW; i++) {
+      up += nums[i] > nums[i - 1];
+      down += nums[i] < nums[i - 1];
+    }
+    breaks += up < down ? up : down;
+    pairs += AUTO_WINDOW - 1;
+  }
+  return (double) breaks / pairs;
+}
+
+
+// Pick the engine for the loaded array and log the decision.
+engine_t auto_select(const long *nums, long count, int threads) {
+  if (count < AUTO_SMALL) {
+    log("Auto engine: %ld elements are too few to sample, picked merge.\n", count);
+    return ENGINE_MERGE;
+  }
+
+  double breaks = run_breaks(nums, count);
+
+  // a sorted random sample gives the key range and the duplicates
+  long *sample = malloc(2 * AUTO_SAMPLE * sizeof(long));
+  assert(sample != NULL);
+  unsigned long state = 42;
+  for (long i = 0; i < AUTO_SAMPLE; i++) {
+    sample[i] = nums[next_random(&state) % count];
+  }
+  sort_run(sample, &sample[AUTO_SAMPLE], AUTO_SAMPLE);
+  long distinct = 1;
+  for (long i = 1; i < AUTO_SAMPLE; i++) {
+    distinct += sample[i] != sample[i - 1];
+  }
+  unsigned long range = (unsigned long) sample[AUTO_SAMPLE - 1] - (unsigned long) sample[0];
+  int bits = range == 0 ? 0 : 64 - __builtin_clzl(range);
+  double duplicates = 1 - (double) distinct / AUTO_SAMPLE;
+  free(sample);
+
+  engine_t engine;
+  const char *reason;
+  if (breaks <= AUTO_RUN_BREAKS) {
+    engine = ENGINE_ADAPTIVE;
+    reason = "long natural runs";
+  }
+  else if (bits <= AUTO_RADIX_BITS) {
+    engine = ENGINE_RADIX;
+    reason = "narrow key range";
+  }
+  else if (duplicates >= AUTO_DUPLICATES) {
+    engine = ENGINE_RADIX;
+    reason = "many duplicates";
+  }
+  else if (threads > 1) {
+    engine = ENGINE_SAMPLE;
+    reason = "wide unique keys, several threads";
+  }
+  else {
+    engine = ENGINE_MERGE;
+    reason = "wide unique keys, one thread";
+  }
+
+  log("Auto engine: %.2f%% run breaks, %d key bits, %.1f%% duplicates in the sample, "
+      "picked %s (%s).\n", 100 * breaks, bits, 100 * duplicates, engine_names[engine], reason);
+  return engine;
+}
@@ -0,0 +1,49 @@
+/**
+ * Engine selection for tmsort -e auto from a sample of the input.
+ */
+#ifndef AUTOSELECT_H
+#define AUTOSELECT_H
+
+#include "tmsort.h"
+
+/** Inputs smaller than this go to the merge engine without sampling. */
+#define AUTO_SMALL (1L << 13)
+
+/** Windows of consecutive elements checked for presortedness. */
+#define AUTO_WINDOWS 256
+
+/** Elements per presortedness window. */
+#define AUTO_WINDOW 32
+
+/** Randomly placed elements sampled for the key range and duplicates. */
+#define AUTO_SAMPLE 4096
+
+/** Run breaks per adjacent pair below which the adaptive engine wins. */
+#define AUTO_RUN_BREAKS (1.0 / 64)
+
+/** Key ranges of at most this many bits take few enough radix passes. */
+#define AUTO_RADIX_BITS 44
+
+/** Duplicate share of the sample above which radix wins on any key range. */
+#define AUTO_DUPLICATES 0.5
+
+/**
+ * Pick the engine for the loaded array and log the decision.
+ *
+ * Checks windows of consecutive elements for how often they switch between
+ * ascending and descending, which estimates the number of natural runs. A
+ * random sample gives the key range (and so the number of radix passes that
+ * are not skipped) and the share of duplicates. Long runs go to the
+ * adaptive engine, narrow or heavily duplicated keys to radix, and the rest
+ * to the merge engine on one thread or sample sort on several, where the
+ * top merge levels would leave threads idle. The thresholds come from the
+ * measurements in experiments.md.
+ *
+ * @param nums The loaded array.
+ * @param count Number of elements.
+ * @param threads Number of threads the sort will use.
+ * @return The engine to run, never ENGINE_AUTO.
+ */
+engine_t auto_select(const long *nums, long count, int threads);
+
+#endif
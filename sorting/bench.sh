@@ -0,0 +1,119 @@
+#!/bin/sh
+#
+# Sorting benchmark harness.
+#
+# Generates inputs with ./gen, runs msort and the tmsort engines over every
+# combination of distribution, size and thread count, and records the read,
+# sort and print times each run logs.
+#
+# Settings come from the environment (defaults in brackets):
+#   BENCH_SIZES    input sizes                      [1000000 10000000]
+#   BENCH_DISTS    input distributions              [uniform sorted reverse few-unique zipf]
+#   BENCH_THREADS  values of MSORT_THREADS          [1 2 4 8]
+#   BENCH_REPS     repetitions of every run         [3]
+#   BENCH_ENGINES  "msort" and/or tmsort engines    [msort merge radix multiway sample adaptive auto]
+#                  "lsort" and "sort" (LC_ALL=C sort, whose total time is
+#                  recorded as its sort time) compare the line sorts
+#   BENCH_OUT      output directory                 [bench-results]
+#
+# Writes $BENCH_OUT/results.csv with one row per run and
+# $BENCH_OUT/summary.csv with the median and standard deviation of each phase.
+set -e
+
+SIZES=${BENCH_SIZES:-"1000000 10000000"}
+DISTS=${BENCH_DISTS:-"uniform sorted reverse few-unique zipf"}
+THREADS=${BENCH_THREADS:-"1 2 4 8"}
+REPS=${BENCH_REPS:-3}
+ENGINES=${BENCH_ENGINES:-"msort merge radix multiway sample adaptive auto"}
+OUT=${BENCH_OUT:-bench-results}
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+mkdir -p "$OUT/inputs"
+RESULTS="$OUT/results.csv"
+SUMMARY="$OUT/summary.csv"
+LOG=$(mktemp)
+trap 'rm -f "$LOG"' EXIT
+
+echo "dist,size,engine,threads,rep,read_s,sort_s,print_s" > "$RESULTS"
+
+for dist in $DISTS; do
+  for size in $SIZES; do
+    input="$OUT/inputs/$dist-$size.txt"
+    if [ ! -s "$input" ]; then
+      echo "== Generating $input =="
+      "$HERE/gen" "$dist" "$size" > "$input"
+    fi
+
+    for engine in $ENGINES; do
+      # msort is single-threaded, so one thread count is enough
+      threads_list=$THREADS
+      if [ "$engine" = msort ]; then
+        threads_list=1
+      fi
+
+      for threads in $threads_list; do
+        rep=1
+        while [ "$rep" -le "$REPS" ]; do
+          if [ "$engine" = sort ]; then
+            begin=$(date +%s.%N)
+            LC_ALL=C sort --parallel="$threads" "$input" > /dev/null
+            awk -v b="$begin" -v e="$(date +%s.%N)" \
+              'BEGIN { printf "Sorting completed in %f seconds.\n", e - b }' > "$LOG"
+          elif [ "$engine" = lsort ]; then
+            MSORT_THREADS=$threads "$HERE/lsort" < "$input" > /dev/null 2> "$LOG"
+          elif [ "$engine" = msort ]; then
+            MSORT_THREADS=$threads "$HERE/msort" "$size" < "$input" > /dev/null 2> "$LOG"
+          else
+            MSORT_THREADS=$threads "$HERE/tmsort" -e "$engine" "$size" < "$input" > /dev/null 2> "$LOG"
+          fi
+
+          awk -v prefix="$dist,$size,$engine,$threads,$rep" '
+            /^Array read in/        { read = $4 }
+            /^Sorting completed in/ { sort = $4 }
+            /^Array printed in/     { print_s = $4 }
+            END { printf "%s,%s,%s,%s\n", prefix, read, sort, print_s }
+          ' "$LOG" | tee -a "$RESULTS"
+          rep=$((rep + 1))
+        done
+      done
+    done
+  done
+done
+
+# median and standard deviation of every phase, per configuration
+awk -F, '
+  function median(list,    n, v, i, j, t) {
+    n = split(list, v, " ")
+    for (i = 2; i <= n; i++) {
+      t = v[i] + 0
+      for (j = i - 1; j >= 1 && v[j] + 0 > t; j--) v[j + 1] = v[j]
+      v[j + 1] = t
+    }
+    return n % 2 ? v[(n + 1) / 2] : (v[n / 2] + v[n / 2 + 1]) / 2
+  }
+  function stddev(list,    n, v, i, sum, sq) {
+    n = split(list, v, " ")
+    for (i = 1; i <= n; i++) { sum += v[i]; sq += v[i] * v[i] }
+    return n > 1 ? sqrt((sq - sum * sum / n) / (n - 1)) : 0
+  }
+  NR > 1 {
+    key = $1 "," $2 "," $3 "," $4
+    if (!(key in reads)) order[++nkeys] = key
+    reads[key] = reads[key] " " $6
+    sorts[key] = sorts[key] " " $7
+    prints[key] = prints[key] " " $8
+  }
+  END {
+    print "dist,size,engine,threads,read_median,read_stddev,sort_median,sort_stddev,print_median,print_stddev"
+    for (i = 1; i <= nkeys; i++) {
+      k = order[i]
+      printf "%s,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n", k,
+        median(reads[k]), stddev(reads[k]), median(sorts[k]), stddev(sorts[k]),
+        median(prints[k]), stddev(prints[k])
+    }
+  }
+' "$RESULTS" > "$SUMMARY"
+
+echo
+echo "== Summary ($SUMMARY) =="
+column -s, -t < "$SUMMARY" 2>/dev/null || cat "$SUMMARY"
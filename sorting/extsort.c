@@ -0,0 +1,230 @@
+/**
+ * External merge sort for inputs larger than memory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "tmsort.h"
+#include "psort.h"
+#include "extsort.h"
+#include "losertree.h"
+
+/** Smallest read-ahead buffer per run, in elements (64 KB). */
+#define MIN_RUN_BUFFER 8192
+
+// A sorted run on disk and its read-ahead buffer
+typedef struct run {
+  int fd;
+  long remaining; // elements not yet read from disk
+  long *buf;
+  long len;       // elements in buf
+  long pos;       // next element of buf to merge
+} run_t;
+
+
+/**
+ * Read up to max longs from stdin into buf, returning how many were read.
+ */
+static long read_chunk(long *buf, long max) {
+  long i = 0;
+  long element;
+  while (i < max && scanf("%ld", &element) == 1) {
+    buf[i++] = element;
+  }
+  return i;
+}
+
+
+/**
+ * Write all of buf to fd. Returns 0 on success, -1 on error.
+ */
+static int write_all(int fd, const void *buf, size_t bytes) {
+  const char *p = buf;
+  while (bytes > 0) {
+    ssize_t n = write(fd, p, bytes);
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    bytes -= n;
+  }
+  return 0;
+}
+
+
+/**
+ * Create an anonymous run file in tmp_dir. Returns its fd, or -1 on error.
+ */
+static int create_run_file(const char *tmp_dir) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/tmsort-run-XXXXXX", tmp_dir);
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    return -1;
+  }
+  // the file lives on until it is closed
+  unlink(path);
+  return fd;
+}
+
+
+/**
+ * Refill the run's buffer from disk. Returns 0 on success, -1 on error.
+ */
+static int refill(run_t *run, long capacity) {
+  long want = run->remaining < capacity ? run->remaining : capacity;
+  size_t bytes = want * sizeof(long);
+  char *p = (char *) run->buf;
+  while (bytes > 0) {
+    ssize_t n = read(run->fd, p, bytes);
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    bytes -= n;
+  }
+  run->remaining -= want;
+  run->len = want;
+  run->pos = 0;
+  return 0;
+}
+
+
+/**
+ * K-way merge the runs through a loser tree and print the result.
+ */
+static int merge_runs_to_stdout(run_t *runs, int k, long budget) {
+  long capacity = budget / k / sizeof(long);
+  if (capacity < MIN_RUN_BUFFER) {
+    capacity = MIN_RUN_BUFFER;
+  }
+
+  losertree_t lt;
+  lt_init(&lt, k);
+  for (int i = 0; i < k; i++) {
+    runs[i].buf = malloc(capacity * sizeof(long));
+    assert(runs[i].buf != NULL);
+    lseek(runs[i].fd, 0, SEEK_SET);
+    if (refill(&runs[i], capacity) != 0) {
+      lt_free(&lt);
+      return -1;
+    }
+    lt_set(&lt, i, runs[i].buf[0]);
+  }
+  lt_build(&lt);
+
+  int src;
+  while ((src = lt_winner(&lt)) != -1) {
+    run_t *run = &runs[src];
+    printf("%ld\n", run->buf[run->pos++]);
+
+    if (run->pos == run->len && run->remaining > 0) {
+      if (refill(run, capacity) != 0) {
+        lt_free(&lt);
+        return -1;
+      }
+    }
+    if (run->pos < run->len) {
+      lt_replace(&lt, run->buf[run->pos]);
+    }
+    else {
+      lt_exhaust(&lt);
+    }
+  }
+
+  lt_free(&lt);
+  return 0;
+}
+
+
+// Sort up to count longs from stdin within the given memory budget.
+int external_sort(long count, long budget, const char *tmp_dir) {
+  struct timeval begin, end;
+
+  // the chunk and the merge sort's result buffer share the budget
+  long chunk = budget / (2 * sizeof(long));
+  if (chunk < 1) {
+    chunk = 1;
+  }
+  long *buf = malloc(chunk * sizeof(long));
+  assert(buf != NULL);
+
+  int nruns = 0;
+  int cap = 16;
+  run_t *runs = malloc(cap * sizeof(run_t));
+  assert(runs != NULL);
+
+  gettimeofday(&begin, 0);
+  long total = 0;
+  int rv = 0;
+  while (total < count) {
+    long want = count - total < chunk ? count - total : chunk;
+    long n = read_chunk(buf, want);
+    if (n == 0) {
+      break;
+    }
+    total += n;
+    long *sorted = psort_long_copy(buf, n, max_thread_count);
+
+    // everything fit in one chunk, so there is nothing to merge
+    if (nruns == 0 && (n < want || total == count)) {
+      for (long i = 0; i < n; i++) {
+        printf("%ld\n", sorted[i]);
+      }
+      free(sorted);
+      free(buf);
+      free(runs);
+      gettimeofday(&end, 0);
+      log("Sorted in memory in %f seconds.\n", time_in_secs(&begin, &end));
+      return 0;
+    }
+
+    if (nruns == cap) {
+      cap *= 2;
+      runs = realloc(runs, cap * sizeof(run_t));
+      assert(runs != NULL);
+    }
+    run_t *run = &runs[nruns];
+    run->fd = create_run_file(tmp_dir);
+    run->remaining = n;
+    run->buf = NULL;
+    if (run->fd == -1) {
+      perror(tmp_dir);
+      free(sorted);
+      rv = -1;
+      break;
+    }
+    nruns++;
+    rv = write_all(run->fd, sorted, n * sizeof(long));
+    free(sorted);
+    if (rv != 0) {
+      perror("write run");
+      break;
+    }
+  }
+  free(buf);
+  gettimeofday(&end, 0);
+
+  if (rv == 0 && nruns > 0) {
+    log("Formed %d run(s) of up to %ld elements in %f seconds.\n",
+        nruns, chunk, time_in_secs(&begin, &end));
+
+    gettimeofday(&begin, 0);
+    rv = merge_runs_to_stdout(runs, nruns, budget);
+    if (rv != 0) {
+      perror("read run");
+    }
+    gettimeofday(&end, 0);
+    log("Runs merged and printed in %f seconds.\n", time_in_secs(&begin, &end));
+  }
+
+  for (int i = 0; i < nruns; i++) {
+    close(runs[i].fd);
+    free(runs[i].buf);
+  }
+  free(runs);
+  return rv;
+}
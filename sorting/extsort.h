@@ -0,0 +1,27 @@
+/**
+ * External merge sort for inputs larger than memory.
+ */
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+/** Default memory budget in megabytes. */
+#define EXTSORT_DEFAULT_BUDGET_MB 1024
+
+/**
+ * Sort up to count longs from stdin within the given memory budget and print
+ * them to stdout, an element per line.
+ *
+ * The input is read in chunks that fit in the budget. Each chunk is sorted
+ * with the threaded merge sort and written as a run to a file in tmp_dir,
+ * and the runs are then k-way merged through a loser tree. Input that fits
+ * in a single chunk never touches the disk.
+ *
+ * @param count Maximum number of elements to read.
+ * @param budget Memory budget in bytes.
+ * @param tmp_dir Directory for the run files, which are unlinked on creation.
+ *
+ * @return 0 on success, -1 if a run file could not be created or accessed.
+ */
+int external_sort(long count, long budget, const char *tmp_dir);
+
+#endif
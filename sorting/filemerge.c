@@ -0,0 +1,385 @@
+/**
+ * Merge of pre-sorted input files, like sort -m.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tmsort.h"
+#include "filemerge.h"
+#include "losertree.h"
+#include "multiway.h"
+#include "topology.h"
+
+/** Elements formatted and written at a time by the streaming merge. */
+#define OUTPUT_BLOCK (1 << 16)
+
+// A sorted input file and its read-ahead buffer
+typedef struct source {
+  FILE *in;
+  int binary;
+  long_reader_t reader;  // text files
+  long *buf;             // binary files
+  long len;              // elements in buf
+  long pos;              // next element of buf
+} source_t;
+
+// A mapped binary file for the parallel merge
+typedef struct mapping {
+  const long *nums;
+  long len;
+  size_t bytes;
+} mapping_t;
+
+// State shared by the parallel merge workers and the writer
+typedef struct range_shared {
+  const long *const *runs;
+  const long *lens;
+  int k;
+  long total;
+  long ranges;
+  long claimed;     // ranges handed to workers
+  long written;     // ranges written out
+  int slots;        // ranges in flight
+  char **text;      // formatted range in each slot
+  size_t *bytes;    // length of the text, 0 while the range is being merged
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+} range_shared;
+
+// Helper struct to pass custom arguments to pthread_create
+typedef struct range_args {
+  range_shared *shared;
+  int slot;
+} range_args;
+
+
+/**
+ * Open a sorted input file. Returns 0 on success, -1 on error.
+ */
+static int source_open(source_t *src, const char *path, int binary) {
+  src->in = fopen(path, "r");
+  if (src->in == NULL) {
+    return -1;
+  }
+  // let the kernel read further ahead on top of our own buffer
+  posix_fadvise(fileno(src->in), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  src->binary = binary;
+  src->buf = NULL;
+  src->len = src->pos = 0;
+  if (binary) {
+    src->buf = malloc(FILEMERGE_READ_AHEAD);
+    assert(src->buf != NULL);
+  }
+  else {
+    long_reader_init(&src->reader, src->in);
+  }
+  return 0;
+}
+
+
+/**
+ * Read the next element of a source. Returns 1 on success, 0 at its end.
+ */
+static int source_next(source_t *src, long *out) {
+  if (!src->binary) {
+    return long_reader_next(&src->reader, out);
+  }
+  if (src->pos == src->len) {
+    src->len = fread(src->buf, sizeof(long), FILEMERGE_READ_AHEAD / sizeof(long), src->in);
+    src->pos = 0;
+    if (src->len == 0) {
+      return 0;
+    }
+  }
+  *out = src->buf[src->pos++];
+  return 1;
+}
+
+
+/**
+ * Close a source and free its buffers.
+ */
+static void source_close(source_t *src) {
+  if (!src->binary) {
+    long_reader_free(&src->reader);
+  }
+  free(src->buf);
+  fclose(src->in);
+}
+
+
+/**
+ * Merge the sources through a loser tree on one thread.
+ */
+static int merge_streams(char *const *paths, int k, int binary) {
+  source_t *srcs = malloc(k * sizeof(source_t));
+  long *block = malloc(OUTPUT_BLOCK * sizeof(long));
+  char *text = malloc(OUTPUT_BLOCK * FORMATTED_LONG_MAX);
+  assert(srcs != NULL && block != NULL && text != NULL);
+
+  int opened = 0;
+  int rv = 0;
+  for (; opened < k; opened++) {
+    if (source_open(&srcs[opened], paths[opened], binary) != 0) {
+      fprintf(stderr, "Cannot open %s\n", paths[opened]);
+      rv = -1;
+      break;
+    }
+  }
+
+  if (rv == 0) {
+    losertree_t lt;
+    lt_init(&lt, k);
+    for (int i = 0; i < k; i++) {
+      long x;
+      if (source_next(&srcs[i], &x)) {
+        lt_set(&lt, i, x);
+      }
+    }
+    lt_build(&lt);
+
+    long len = 0;
+    int src;
+    while ((src = lt_winner(&lt)) != -1) {
+      block[len++] = lt_winner_key(&lt);
+      if (len == OUTPUT_BLOCK) {
+        fwrite(text, 1, format_long_array(block, len, text), stdout);
+        len = 0;
+      }
+      long x;
+      if (source_next(&srcs[src], &x)) {
+        lt_replace(&lt, x);
+      }
+      else {
+        lt_exhaust(&lt);
+      }
+    }
+    fwrite(text, 1, format_long_array(block, len, text), stdout);
+    lt_free(&lt);
+  }
+
+  for (int i = 0; i < opened; i++) {
+    source_close(&srcs[i]);
+  }
+  free(srcs);
+  free(block);
+  free(text);
+  return rv;
+}
+
+
+/**
+ * Merge and format output ranges until none are left.
+ */
+static void *range_worker(void *arg_in) {
+  range_args *arg = arg_in;
+  range_shared *sh = arg->shared;
+  topo_pin(arg->slot);
+
+  int k = sh->k;
+  long *cur = malloc(k * sizeof(long));
+  long *end = malloc(k * sizeof(long));
+  long *block = malloc(FILEMERGE_RANGE * sizeof(long));
+  assert(cur != NULL && end != NULL && block != NULL);
+  losertree_t lt;
+  lt_init(&lt, k);
+
+  for (;;) {
+    // claim the next range and wait for its slot to be written out
+    pthread_mutex_lock(&sh->lock);
+    long r = sh->claimed;
+    if (r == sh->ranges) {
+      pthread_mutex_unlock(&sh->lock);
+      break;
+    }
+    sh->claimed++;
+    while (r - sh->written >= sh->slots) {
+      pthread_cond_wait(&sh->changed, &sh->lock);
+    }
+    pthread_mutex_unlock(&sh->lock);
+
+    long from = r * FILEMERGE_RANGE;
+    long to = from + FILEMERGE_RANGE < sh->total ? from + FILEMERGE_RANGE : sh->total;
+    multiway_split(sh->runs, sh->lens, k, from, cur);
+    multiway_split(sh->runs, sh->lens, k, to, end);
+
+    for (int i = 0; i < k; i++) {
+      if (cur[i] < end[i]) {
+        lt_set(&lt, i, sh->runs[i][cur[i]]);
+      }
+    }
+    lt_build(&lt);
+    long len = 0;
+    int src;
+    while ((src = lt_winner(&lt)) != -1) {
+      block[len++] = lt_winner_key(&lt);
+      if (++cur[src] < end[src]) {
+        lt_replace(&lt, sh->runs[src][cur[src]]);
+      }
+      else {
+        lt_exhaust(&lt);
+      }
+    }
+
+    int slot = r % sh->slots;
+    size_t bytes = format_long_array(block, len, sh->text[slot]);
+
+    pthread_mutex_lock(&sh->lock);
+    sh->bytes[slot] = bytes;
+    pthread_cond_broadcast(&sh->changed);
+    pthread_mutex_unlock(&sh->lock);
+  }
+
+  lt_free(&lt);
+  free(cur);
+  free(end);
+  free(block);
+  return NULL;
+}
+
+
+/**
+ * Merge mapped binary files with the workers taking output ranges.
+ */
+static int merge_ranges(char *const *paths, int k, int threads) {
+  mapping_t *maps = malloc(k * sizeof(mapping_t));
+  const long **runs = malloc(k * sizeof(long *));
+  long *lens = malloc(k * sizeof(long));
+  assert(maps != NULL && runs != NULL && lens != NULL);
+
+  int mapped = 0;
+  int rv = 0;
+  long total = 0;
+  for (; mapped < k; mapped++) {
+    int fd = open(paths[mapped], O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+      fprintf(stderr, "Cannot open %s\n", paths[mapped]);
+      if (fd != -1) {
+        close(fd);
+      }
+      rv = -1;
+      break;
+    }
+    mapping_t *m = &maps[mapped];
+    m->len = st.st_size / sizeof(long);
+    m->bytes = st.st_size;
+    m->nums = NULL;
+    if (m->bytes > 0) {
+      m->nums = mmap(NULL, m->bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (m->nums == MAP_FAILED) {
+        fprintf(stderr, "Cannot map %s\n", paths[mapped]);
+        close(fd);
+        rv = -1;
+        break;
+      }
+      madvise((void *) m->nums, m->bytes, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    runs[mapped] = m->nums;
+    lens[mapped] = m->len;
+    total += m->len;
+  }
+
+  if (rv == 0) {
+    range_shared sh;
+    sh.runs = runs;
+    sh.lens = lens;
+    sh.k = k;
+    sh.total = total;
+    sh.ranges = (total + FILEMERGE_RANGE - 1) / FILEMERGE_RANGE;
+    sh.claimed = sh.written = 0;
+    sh.slots = 2 * threads;
+    sh.text = malloc(sh.slots * sizeof(char *));
+    sh.bytes = calloc(sh.slots, sizeof(size_t));
+    assert(sh.text != NULL && sh.bytes != NULL);
+    for (int s = 0; s < sh.slots; s++) {
+      sh.text[s] = malloc(FILEMERGE_RANGE * FORMATTED_LONG_MAX);
+      assert(sh.text[s] != NULL);
+    }
+    pthread_mutex_init(&sh.lock, NULL);
+    pthread_cond_init(&sh.changed, NULL);
+
+    range_args *args = malloc(threads * sizeof(range_args));
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    assert(args != NULL && tids != NULL);
+    for (int t = 0; t < threads; t++) {
+      args[t].shared = &sh;
+      args[t].slot = t;
+      pthread_create(&tids[t], NULL, range_worker, &args[t]);
+    }
+
+    // write the ranges out in order as they are finished
+    for (long r = 0; r < sh.ranges; r++) {
+      int slot = r % sh.slots;
+      pthread_mutex_lock(&sh.lock);
+      while (sh.bytes[slot] == 0) {
+        pthread_cond_wait(&sh.changed, &sh.lock);
+      }
+      pthread_mutex_unlock(&sh.lock);
+
+      fwrite(sh.text[slot], 1, sh.bytes[slot], stdout);
+
+      pthread_mutex_lock(&sh.lock);
+      sh.bytes[slot] = 0;
+      sh.written++;
+      pthread_cond_broadcast(&sh.changed);
+      pthread_mutex_unlock(&sh.lock);
+    }
+
+    for (int t = 0; t < threads; t++) {
+      pthread_join(tids[t], NULL);
+    }
+    for (int s = 0; s < sh.slots; s++) {
+      free(sh.text[s]);
+    }
+    pthread_mutex_destroy(&sh.lock);
+    pthread_cond_destroy(&sh.changed);
+    free(sh.text);
+    free(sh.bytes);
+    free(args);
+    free(tids);
+  }
+
+  for (int i = 0; i < mapped; i++) {
+    if (maps[i].bytes > 0) {
+      munmap((void *) maps[i].nums, maps[i].bytes);
+    }
+  }
+  free(maps);
+  free(runs);
+  free(lens);
+  return rv;
+}
+
+
+// K-way merge the sorted input files and print the result.
+int merge_files(char *const *paths, int k, int binary, int threads) {
+  struct timeval begin, end;
+  gettimeofday(&begin, 0);
+
+  int parallel = binary && threads > 1;
+  log("Merging %d %s file(s) with %d thread(s).\n", k, binary ? "binary" : "text",
+      parallel ? threads : 1);
+
+  int rv;
+  if (parallel) {
+    rv = merge_ranges(paths, k, threads);
+  }
+  else {
+    rv = merge_streams(paths, k, binary);
+  }
+  fflush(stdout);
+
+  gettimeofday(&end, 0);
+  log("Merged %d file(s) in %f seconds.\n", k, time_in_secs(&begin, &end));
+  return rv;
+}
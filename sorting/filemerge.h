@@ -0,0 +1,38 @@
+/**
+ * Merge of pre-sorted input files, like sort -m.
+ */
+#ifndef FILEMERGE_H
+#define FILEMERGE_H
+
+/** Read-ahead buffer per input file, in bytes. */
+#define FILEMERGE_READ_AHEAD (4L << 20)
+
+/** Elements per output range merged by one worker in parallel mode. */
+#define FILEMERGE_RANGE (1L << 18)
+
+/**
+ * K-way merge the sorted input files through a loser tree and print the
+ * result to stdout, an element per line.
+ *
+ * Text files hold whitespace-separated decimal longs. Binary files hold
+ * native-endian longs back to back, like the run files of the external
+ * sort. Every file is read through a FILEMERGE_READ_AHEAD buffer.
+ *
+ * Binary files can also be merged in parallel when threads > 1. The files
+ * are mapped into memory, and the output is cut into ranges of
+ * FILEMERGE_RANGE elements. The workers find the start of each range in
+ * every file by binary search (multiway_split()) and then merge and format
+ * their ranges independently, while the main thread writes the finished
+ * ranges out in order.
+ *
+ * The inputs are not checked for being sorted.
+ *
+ * @param paths The input files.
+ * @param k Number of input files.
+ * @param binary Whether the files are binary instead of text.
+ * @param threads Number of threads to use.
+ * @return 0 on success, -1 if a file could not be opened or read.
+ */
+int merge_files(char *const *paths, int k, int binary, int threads);
+
+#endif
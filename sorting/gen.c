@@ -0,0 +1,91 @@
+/**
+ * Generate benchmark inputs for msort and tmsort.
+ *
+ * Usage: gen <uniform|sorted|reverse|few-unique|zipf|urls> <n> [seed]
+ *
+ * Prints n numbers, one per line:
+ *   uniform     random values in 1..n
+ *   sorted      1..n in order
+ *   reverse     n..1
+ *   few-unique  random values from 16 distinct keys
+ *   zipf        values in 1..n, value k drawn with probability ~ 1/k
+ *   urls        URL-like lines with long shared prefixes, for lsort
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * Next value of a xorshift64* generator.
+ */
+static unsigned long next_random(unsigned long *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717UL;
+}
+
+/**
+ * Uniform double in [0, 1).
+ */
+static double next_unit(unsigned long *state) {
+  return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3 || argc > 4) {
+    fprintf(stderr, "Usage: %s <uniform|sorted|reverse|few-unique|zipf|urls> <n> [seed]\n", argv[0]);
+    return 1;
+  }
+
+  const char *dist = argv[1];
+  long n = atol(argv[2]);
+  unsigned long state = argc == 4 ? strtoul(argv[3], NULL, 10) : 42;
+  if (state == 0) {
+    state = 42;
+  }
+
+  if (strcmp(dist, "uniform") == 0) {
+    for (long i = 0; i < n; i++) {
+      printf("%lu\n", next_random(&state) % n + 1);
+    }
+  }
+  else if (strcmp(dist, "sorted") == 0) {
+    for (long i = 1; i <= n; i++) {
+      printf("%ld\n", i);
+    }
+  }
+  else if (strcmp(dist, "reverse") == 0) {
+    for (long i = n; i >= 1; i--) {
+      printf("%ld\n", i);
+    }
+  }
+  else if (strcmp(dist, "few-unique") == 0) {
+    for (long i = 0; i < n; i++) {
+      printf("%lu\n", (next_random(&state) % 16 + 1) * 1000003);
+    }
+  }
+  else if (strcmp(dist, "zipf") == 0) {
+    // invert the continuous approximation of the Zipf(1) distribution
+    double log_range = log((double) n + 1);
+    for (long i = 0; i < n; i++) {
+      long k = (long) exp(next_unit(&state) * log_range);
+      printf("%ld\n", k < 1 ? 1 : (k > n ? n : k));
+    }
+  }
+  else if (strcmp(dist, "urls") == 0) {
+    // few hosts and sections, so lines share prefixes well past 8 bytes
+    for (long i = 0; i < n; i++) {
+      unsigned long r = next_random(&state);
+      printf("https://www%lu.example.com/section/%lu/item?id=%lu\n",
+             r % 4, (r >> 2) % 32, (r >> 7) % n);
+    }
+  }
+  else {
+    fprintf(stderr, "Unknown distribution: %s\n", dist);
+    return 1;
+  }
+
+  return 0;
+}
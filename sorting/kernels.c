@@ -0,0 +1,479 @@
+/**
+ * Vectorized merge and small-block sort kernels.
+ *
+ * The SIMD kernels follow the bitonic merge scheme: two sorted vectors are
+ * merged by reversing one, taking the lane-wise min and max, and cleaning
+ * each half with a couple of shuffle/min/max steps. The merge loop keeps the
+ * upper half in a register and reloads from whichever run has the smaller
+ * head, so it branches once per vector instead of once per element.
+ *
+ * Merges larger than the last-level cache go through a variant of the AVX2
+ * merge that prefetches both runs and writes with non-temporal stores, so
+ * the output neither evicts the working set nor is read before it is
+ * overwritten.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "kernels.h"
+#include "topology.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+
+/**
+ * Merge sorted runs a and b into out without branching on the comparison.
+ */
+static void merge_scalar(const long *a, long na, const long *b, long nb, long *out) {
+  const long *a_end = a + na;
+  const long *b_end = b + nb;
+
+  while (a < a_end && b < b_end) {
+    long x = *a;
+    long y = *b;
+    int take_a = x <= y;
+    *out++ = take_a ? x : y;
+    a += take_a;
+    b += !take_a;
+  }
+  memcpy(out, a, (a_end - a) * sizeof(long));
+  out += a_end - a;
+  // b's tail may already be in place, see merge_runs()
+  memmove(out, b, (b_end - b) * sizeof(long));
+}
+
+
+/**
+ * Merge three sorted runs into out. Used to finish the vector merges.
+ */
+static void merge3_scalar(const long *a, long na, const long *b, long nb,
+                          const long *c, long nc, long *out) {
+  while (na > 0 && nb > 0 && nc > 0) {
+    if (*a <= *b && *a <= *c) {
+      *out++ = *a++;
+      na--;
+    }
+    else if (*b <= *c) {
+      *out++ = *b++;
+      nb--;
+    }
+    else {
+      *out++ = *c++;
+      nc--;
+    }
+  }
+  if (na == 0) {
+    merge_scalar(b, nb, c, nc, out);
+  }
+  else if (nb == 0) {
+    merge_scalar(a, na, c, nc, out);
+  }
+  else {
+    merge_scalar(a, na, b, nb, out);
+  }
+}
+
+
+/**
+ * Insertion sort, fastest for the handful of elements at the leaves.
+ */
+static void small_sort_scalar(long *nums, int count) {
+  for (int i = 1; i < count; i++) {
+    long x = nums[i];
+    int j = i;
+    while (j > 0 && nums[j - 1] > x) {
+      nums[j] = nums[j - 1];
+      j--;
+    }
+    nums[j] = x;
+  }
+}
+
+
+#ifdef KERNELS_X86
+
+#define SSE42 __attribute__((target("sse4.2")))
+#define AVX2 __attribute__((target("avx2")))
+
+// Put the lane-wise minimum of a and b in a and the maximum in b.
+static inline SSE42 void minmax2(__m128i *a, __m128i *b) {
+  __m128i gt = _mm_cmpgt_epi64(*a, *b);
+  __m128i mn = _mm_blendv_epi8(*a, *b, gt);
+  __m128i mx = _mm_blendv_epi8(*b, *a, gt);
+  *a = mn;
+  *b = mx;
+}
+
+// Sort a bitonic pair.
+static inline SSE42 __m128i clean2(__m128i v) {
+  __m128i s = _mm_shuffle_epi32(v, 0x4E);
+  minmax2(&v, &s);
+  return _mm_blend_epi16(v, s, 0xF0);
+}
+
+// Merge the sorted pairs a and b; a gets the lower half, b the upper.
+static inline SSE42 void merge2(__m128i *a, __m128i *b) {
+  *b = _mm_shuffle_epi32(*b, 0x4E);
+  minmax2(a, b);
+  *a = clean2(*a);
+  *b = clean2(*b);
+}
+
+static SSE42 void merge_sse42(const long *a, long na, const long *b, long nb, long *out) {
+  if (na < 2 || nb < 2) {
+    merge_scalar(a, na, b, nb, out);
+    return;
+  }
+
+  __m128i lo = _mm_loadu_si128((const __m128i *) a);
+  __m128i hi = _mm_loadu_si128((const __m128i *) b);
+  long ia = 2;
+  long ib = 2;
+  for (;;) {
+    merge2(&lo, &hi);
+    _mm_storeu_si128((__m128i *) out, lo);
+    out += 2;
+    lo = hi;
+
+    // the next vector must come from the run with the smaller head
+    if (ia < na && (ib >= nb || a[ia] <= b[ib])) {
+      if (ia + 2 > na) {
+        break;
+      }
+      hi = _mm_loadu_si128((const __m128i *) &a[ia]);
+      ia += 2;
+    }
+    else if (ib < nb) {
+      if (ib + 2 > nb) {
+        break;
+      }
+      hi = _mm_loadu_si128((const __m128i *) &b[ib]);
+      ib += 2;
+    }
+    else {
+      break;
+    }
+  }
+
+  long rest[2];
+  _mm_storeu_si128((__m128i *) rest, lo);
+  merge3_scalar(rest, 2, &a[ia], na - ia, &b[ib], nb - ib, out);
+}
+
+
+// Put the lane-wise minimum of a and b in a and the maximum in b.
+static inline AVX2 void minmax4(__m256i *a, __m256i *b) {
+  __m256i gt = _mm256_cmpgt_epi64(*a, *b);
+  __m256i mn = _mm256_blendv_epi8(*a, *b, gt);
+  __m256i mx = _mm256_blendv_epi8(*b, *a, gt);
+  *a = mn;
+  *b = mx;
+}
+
+// Sort a bitonic vector of four.
+static inline AVX2 __m256i clean4(__m256i v) {
+  // compare lanes two apart
+  __m256i s = _mm256_permute4x64_epi64(v, 0x4E);
+  minmax4(&v, &s);
+  v = _mm256_blend_epi32(v, s, 0xF0);
+
+  // compare neighbouring lanes
+  s = _mm256_permute4x64_epi64(v, 0xB1);
+  minmax4(&v, &s);
+  return _mm256_blend_epi32(v, s, 0xCC);
+}
+
+static inline AVX2 __m256i reverse4(__m256i v) {
+  return _mm256_permute4x64_epi64(v, 0x1B);
+}
+
+// Merge the sorted vectors a and b; a gets the lower half, b the upper.
+static inline AVX2 void merge4(__m256i *a, __m256i *b) {
+  *b = reverse4(*b);
+  minmax4(a, b);
+  *a = clean4(*a);
+  *b = clean4(*b);
+}
+
+// Merge the sorted eights (a0, a1) and (b0, b1) into r[0..3].
+static inline AVX2 void merge8(__m256i a0, __m256i a1, __m256i b0, __m256i b1,
+                               __m256i r[4]) {
+  __m256i c0 = reverse4(b1);
+  __m256i c1 = reverse4(b0);
+  minmax4(&a0, &c0);
+  minmax4(&a1, &c1);
+
+  // both halves are now bitonic eights
+  minmax4(&a0, &a1);
+  minmax4(&c0, &c1);
+  r[0] = clean4(a0);
+  r[1] = clean4(a1);
+  r[2] = clean4(c0);
+  r[3] = clean4(c1);
+}
+
+/**
+ * The AVX2 merge loop. With stream set it prefetches both runs and stores
+ * the vectors with non-temporal stores, which needs out 32-byte aligned;
+ * the first elements are merged one at a time until it is.
+ */
+static inline __attribute__((always_inline)) AVX2 void
+merge_avx2_body(const long *a, long na, const long *b, long nb, long *out, int stream) {
+  if (stream) {
+    while (((uintptr_t) out & 31) != 0 && na > 0 && nb > 0) {
+      int take_a = *a <= *b;
+      *out++ = take_a ? *a : *b;
+      a += take_a;
+      na -= take_a;
+      b += !take_a;
+      nb -= !take_a;
+    }
+  }
+  if (na < 4 || nb < 4) {
+    merge_scalar(a, na, b, nb, out);
+    return;
+  }
+
+  __m256i lo = _mm256_loadu_si256((const __m256i *) a);
+  __m256i hi = _mm256_loadu_si256((const __m256i *) b);
+  long ia = 4;
+  long ib = 4;
+  for (;;) {
+    merge4(&lo, &hi);
+    if (stream) {
+      _mm256_stream_si256((__m256i *) out, lo);
+      _mm_prefetch((const char *) &a[ia + MERGE_PREFETCH], _MM_HINT_T0);
+      _mm_prefetch((const char *) &b[ib + MERGE_PREFETCH], _MM_HINT_T0);
+    }
+    else {
+      _mm256_storeu_si256((__m256i *) out, lo);
+    }
+    out += 4;
+    lo = hi;
+
+    // the next vector must come from the run with the smaller head
+    if (ia < na && (ib >= nb || a[ia] <= b[ib])) {
+      if (ia + 4 > na) {
+        break;
+      }
+      hi = _mm256_loadu_si256((const __m256i *) &a[ia]);
+      ia += 4;
+    }
+    else if (ib < nb) {
+      if (ib + 4 > nb) {
+        break;
+      }
+      hi = _mm256_loadu_si256((const __m256i *) &b[ib]);
+      ib += 4;
+    }
+    else {
+      break;
+    }
+  }
+
+  long rest[4];
+  _mm256_storeu_si256((__m256i *) rest, lo);
+  merge3_scalar(rest, 4, &a[ia], na - ia, &b[ib], nb - ib, out);
+  if (stream) {
+    // order the non-temporal stores before whatever reads the output next
+    _mm_sfence();
+  }
+}
+
+static AVX2 void merge_avx2(const long *a, long na, const long *b, long nb, long *out) {
+  merge_avx2_body(a, na, b, nb, out, 0);
+}
+
+static AVX2 void merge_avx2_stream(const long *a, long na, const long *b, long nb, long *out) {
+  merge_avx2_body(a, na, b, nb, out, 1);
+}
+
+/**
+ * Sort up to 16 elements entirely in registers.
+ *
+ * The block is padded to 16 with LONG_MAX and loaded as a 4x4 matrix. A
+ * five-comparator network sorts the columns, a transpose turns them into
+ * four sorted rows, and two rounds of bitonic merges finish the job.
+ */
+static AVX2 void small_sort_avx2(long *nums, int count) {
+  if (count <= 1) {
+    return;
+  }
+
+  long buf[SMALL_SORT_MAX];
+  memcpy(buf, nums, count * sizeof(long));
+  for (int i = count; i < SMALL_SORT_MAX; i++) {
+    buf[i] = LONG_MAX;
+  }
+
+  __m256i r0 = _mm256_loadu_si256((const __m256i *) &buf[0]);
+  __m256i r1 = _mm256_loadu_si256((const __m256i *) &buf[4]);
+  __m256i r2 = _mm256_loadu_si256((const __m256i *) &buf[8]);
+  __m256i r3 = _mm256_loadu_si256((const __m256i *) &buf[12]);
+
+  // optimal sorting network for four, applied to every column at once
+  minmax4(&r0, &r1);
+  minmax4(&r2, &r3);
+  minmax4(&r0, &r2);
+  minmax4(&r1, &r3);
+  minmax4(&r1, &r2);
+
+  // transpose so every row holds one sorted column
+  __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+  __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+  __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+  __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+  r0 = _mm256_permute2x128_si256(t0, t2, 0x20);
+  r1 = _mm256_permute2x128_si256(t1, t3, 0x20);
+  r2 = _mm256_permute2x128_si256(t0, t2, 0x31);
+  r3 = _mm256_permute2x128_si256(t1, t3, 0x31);
+
+  merge4(&r0, &r1);
+  merge4(&r2, &r3);
+
+  __m256i r[4];
+  merge8(r0, r1, r2, r3, r);
+  for (int i = 0; i < 4; i++) {
+    _mm256_storeu_si256((__m256i *) &buf[4 * i], r[i]);
+  }
+  memcpy(nums, buf, count * sizeof(long));
+}
+
+#endif
+
+
+static void merge_resolve(const long *a, long na, const long *b, long nb, long *out);
+static void small_sort_resolve(long *nums, int count);
+
+// Until kernels_init() runs, the first call of each kernel selects them
+static void (*merge_impl)(const long *, long, const long *, long, long *) = merge_resolve;
+static void (*merge_stream_impl)(const long *, long, const long *, long, long *) = merge_resolve;
+static void (*small_sort_impl)(long *, int) = small_sort_resolve;
+static const char *isa_name = "scalar";
+static long stream_min = LONG_MAX;
+static long tile_count = 0;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+/**
+ * A size from the environment variable name, or fallback if it is not set.
+ */
+static long env_size(const char *name, long fallback) {
+  const char *env = getenv(name);
+  return env != NULL ? atol(env) : fallback;
+}
+
+static void select_kernels(void) {
+  merge_impl = merge_scalar;
+  merge_stream_impl = merge_scalar;
+  small_sort_impl = small_sort_scalar;
+  isa_name = "scalar";
+
+  // stream merges that do not fit in the last-level cache, and sort tiles
+  // that fit in L2 together with their scratch space
+  long stream_mb = env_size("MSORT_STREAM_MB",
+                            topo_cache_bytes(3, KERNELS_LLC_DEFAULT) >> 20);
+  stream_min = stream_mb > 0 ? (stream_mb << 20) / sizeof(long) : LONG_MAX;
+  long tile_kb = env_size("MSORT_TILE_KB", topo_cache_bytes(2, KERNELS_L2_DEFAULT) >> 10);
+  tile_count = (tile_kb << 10) / (2 * sizeof(long));
+
+#ifdef KERNELS_X86
+  const char *cap = getenv("MSORT_ISA");
+  int allow_sse42 = cap == NULL || strcmp(cap, "scalar") != 0;
+  int allow_avx2 = cap == NULL || strcmp(cap, "avx2") == 0;
+
+  __builtin_cpu_init();
+  if (allow_avx2 && __builtin_cpu_supports("avx2")) {
+    merge_impl = merge_avx2;
+    merge_stream_impl = merge_avx2_stream;
+    small_sort_impl = small_sort_avx2;
+    isa_name = "avx2";
+  }
+  else if (allow_sse42 && __builtin_cpu_supports("sse4.2")) {
+    merge_impl = merge_sse42;
+    merge_stream_impl = merge_sse42;
+    isa_name = "sse4.2";
+  }
+#endif
+}
+
+static void merge_resolve(const long *a, long na, const long *b, long nb, long *out) {
+  kernels_init();
+  merge_impl(a, na, b, nb, out);
+}
+
+static void small_sort_resolve(long *nums, int count) {
+  kernels_init();
+  small_sort_impl(nums, count);
+}
+
+// Select the kernels for this CPU.
+void kernels_init(void) {
+  pthread_once(&init_once, select_kernels);
+}
+
+// Name of the instruction set the selected kernels use.
+const char *kernels_isa(void) {
+  kernels_init();
+  return isa_name;
+}
+
+// Merge the sorted runs a and b into out.
+void merge_runs(const long *a, long na, const long *b, long nb, long *out) {
+  // the in-place case reads b after parts of its cache lines were written,
+  // so it keeps the regular stores
+  if (na + nb >= stream_min && out + na != b) {
+    merge_stream_impl(a, na, b, nb, out);
+  }
+  else {
+    merge_impl(a, na, b, nb, out);
+  }
+}
+
+// Largest slice sort_run() should get to stay within the L2 cache.
+long kernels_tile(void) {
+  kernels_init();
+  return tile_count;
+}
+
+// Sort a block of at most SMALL_SORT_MAX elements in place.
+void small_sort(long *nums, int count) {
+  small_sort_impl(nums, count);
+}
+
+// Sort nums in place with a bottom-up merge sort built from the kernels.
+void sort_run(long *nums, long *tmp, long count) {
+  int passes = 0;
+  for (long width = SMALL_SORT_MAX; width < count; width *= 2) {
+    passes++;
+  }
+
+  // start in tmp when the passes would otherwise leave the result there
+  long *src = nums;
+  long *dst = tmp;
+  if (passes % 2 == 1) {
+    memcpy(tmp, nums, count * sizeof(long));
+    src = tmp;
+    dst = nums;
+  }
+
+  for (long i = 0; i < count; i += SMALL_SORT_MAX) {
+    small_sort(&src[i], count - i < SMALL_SORT_MAX ? count - i : SMALL_SORT_MAX);
+  }
+
+  for (long width = SMALL_SORT_MAX; width < count; width *= 2) {
+    for (long i = 0; i < count; i += 2 * width) {
+      long mid = i + width < count ? i + width : count;
+      long end = i + 2 * width < count ? i + 2 * width : count;
+      merge_runs(&src[i], mid - i, &src[mid], end - mid, &dst[i]);
+    }
+    long *swap = src;
+    src = dst;
+    dst = swap;
+  }
+}
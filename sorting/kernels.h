@@ -0,0 +1,71 @@
+/**
+ * Vectorized merge and small-block sort kernels.
+ *
+ * The best kernels the CPU supports (AVX2, SSE4.2 or plain C) are picked at
+ * runtime by kernels_init(). Setting MSORT_ISA to "scalar", "sse4.2" or
+ * "avx2" caps the selection, which is useful for benchmarking.
+ *
+ * Merges of at least MSORT_STREAM_MB megabytes (default: the size of the
+ * last-level cache, 0 turns it off) use non-temporal stores. MSORT_TILE_KB
+ * (default: the size of the L2 cache, 0 turns it off) sets the tile size
+ * kernels_tile() reports.
+ */
+#ifndef KERNELS_H
+#define KERNELS_H
+
+/** Largest block small_sort() accepts. */
+#define SMALL_SORT_MAX 16
+
+/** Elements ahead of the merge position that the streaming merge prefetches. */
+#define MERGE_PREFETCH 64
+
+/** Cache sizes assumed if the system does not report them. */
+#define KERNELS_L2_DEFAULT (256L << 10)
+#define KERNELS_LLC_DEFAULT (32L << 20)
+
+/**
+ * Select the kernels for this CPU. Runs once; the kernels call it themselves
+ * if needed, so calling it up front only moves the cost out of the sort.
+ */
+void kernels_init(void);
+
+/**
+ * Name of the instruction set the selected kernels use.
+ */
+const char *kernels_isa(void);
+
+/**
+ * Merge the sorted runs a and b into out.
+ *
+ * @param a First sorted run.
+ * @param na Length of a.
+ * @param b Second sorted run.
+ * @param nb Length of b.
+ * @param out Destination of na + nb elements. It must not overlap a, and may
+ *            only overlap b if b already sits at its end (out + na == b),
+ *            which merges a into place in front of b.
+ */
+void merge_runs(const long *a, long na, const long *b, long nb, long *out);
+
+/**
+ * Sort a block of at most SMALL_SORT_MAX elements in place.
+ */
+void small_sort(long *nums, int count);
+
+/**
+ * Sort nums in place with a single-threaded bottom-up merge sort built from
+ * the kernels.
+ *
+ * @param nums The elements to sort.
+ * @param tmp Scratch space for count elements.
+ * @param count Number of elements.
+ */
+void sort_run(long *nums, long *tmp, long count);
+
+/**
+ * Largest number of elements sort_run() should be given at once so that the
+ * slice and its scratch space stay in the L2 cache. 0 if tiling is off.
+ */
+long kernels_tile(void);
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * Loser tree (tournament tree) for k-way merging of sorted sources.
+ *
+ * The leaves live at positions k..2k-1 of an implicit binary tree and every
+ * internal node keeps the loser of the match played there, together with its
+ * key, so replacing the winner only replays the log2(k) matches on its path
+ * to the root and each match is a single comparison in the common case.
+ */
+#include <stdlib.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "losertree.h"
+
+// Does source a with key ka win against source b with key kb?
+static inline int beats(const losertree_t *lt, long ka, int a, long kb, int b) {
+  if (ka != kb) {
+    return ka < kb;
+  }
+  // exhausted sources hold LONG_MAX, so only ties need the slow path
+  if (lt->done[a] != lt->done[b]) {
+    return !lt->done[a];
+  }
+  return a < b;
+}
+
+// Allocate a tree for k sources.
+void lt_init(losertree_t *lt, int k) {
+  assert(k > 0);
+  lt->k = k;
+  lt->src = calloc(2 * k, sizeof(int));
+  lt->key = calloc(2 * k, sizeof(long));
+  lt->done = malloc(k);
+  assert(lt->src != NULL && lt->key != NULL && lt->done != NULL);
+  for (int i = 0; i < k; i++) {
+    lt->src[k + i] = i;
+    lt->key[k + i] = LONG_MAX;
+    lt->done[i] = 1;
+  }
+}
+
+// Free the memory held by the tree.
+void lt_free(losertree_t *lt) {
+  free(lt->src);
+  free(lt->key);
+  free(lt->done);
+}
+
+// Set the head key of a source.
+void lt_set(losertree_t *lt, int src, long key) {
+  lt->key[lt->k + src] = key;
+  lt->done[src] = 0;
+}
+
+// Play the initial tournament.
+void lt_build(losertree_t *lt) {
+  int k = lt->k;
+  if (k == 1) {
+    lt->src[0] = 0;
+    lt->key[0] = lt->key[1];
+    return;
+  }
+
+  // winners of the matches below each node
+  int *win = malloc(2 * k * sizeof(int));
+  long *win_key = malloc(2 * k * sizeof(long));
+  assert(win != NULL && win_key != NULL);
+
+  for (int i = k; i < 2 * k; i++) {
+    win[i] = lt->src[i];
+    win_key[i] = lt->key[i];
+  }
+  for (int i = k - 1; i >= 1; i--) {
+    int l = 2 * i;
+    int r = 2 * i + 1;
+    int w = beats(lt, win_key[l], win[l], win_key[r], win[r]) ? l : r;
+    int o = w == l ? r : l;
+    win[i] = win[w];
+    win_key[i] = win_key[w];
+    lt->src[i] = win[o];
+    lt->key[i] = win_key[o];
+  }
+  lt->src[0] = win[1];
+  lt->key[0] = win_key[1];
+
+  free(win);
+  free(win_key);
+}
+
+// Return the source holding the smallest key, or -1 if all are exhausted.
+int lt_winner(const losertree_t *lt) {
+  int w = lt->src[0];
+  return lt->done[w] ? -1 : w;
+}
+
+// Replay the matches from the winner's leaf up to the root.
+static void replay(losertree_t *lt, long key) {
+  int winner = lt->src[0];
+  for (int node = (winner + lt->k) / 2; node >= 1; node /= 2) {
+    if (beats(lt, lt->key[node], lt->src[node], key, winner)) {
+      int tmp = lt->src[node];
+      long tmp_key = lt->key[node];
+      lt->src[node] = winner;
+      lt->key[node] = key;
+      winner = tmp;
+      key = tmp_key;
+    }
+  }
+  lt->src[0] = winner;
+  lt->key[0] = key;
+}
+
+// Replace the winner's key with its next one.
+void lt_replace(losertree_t *lt, long key) {
+  replay(lt, key);
+}
+
+// Mark the winner's source exhausted.
+void lt_exhaust(losertree_t *lt) {
+  int src = lt->src[0];
+  lt->done[src] = 1;
+  // the leaf is read again by lt_build() when the tree is reused
+  lt->key[lt->k + src] = LONG_MAX;
+  replay(lt, LONG_MAX);
+}
@@ -0,0 +1,61 @@
+/**
+ * Loser tree (tournament tree) for k-way merging of sorted sources.
+ */
+#ifndef LOSERTREE_H
+#define LOSERTREE_H
+
+typedef struct losertree {
+  int k;        // number of sources
+  int *src;     // src[0] is the winner, src[1..k-1] the losers of each match
+  long *key;    // key of the source in the same slot, LONG_MAX once exhausted
+  char *done;   // set once a source is exhausted
+} losertree_t;
+
+/**
+ * Allocate a tree for k sources. Every source starts out exhausted.
+ */
+void lt_init(losertree_t *lt, int k);
+
+/**
+ * Free the memory held by the tree.
+ */
+void lt_free(losertree_t *lt);
+
+/**
+ * Set the head key of a source before lt_build().
+ */
+void lt_set(losertree_t *lt, int src, long key);
+
+/**
+ * Play the initial tournament once all sources are set.
+ */
+void lt_build(losertree_t *lt);
+
+/**
+ * Return the source holding the smallest key, or -1 if all are exhausted.
+ *
+ * Ties go to the lower-numbered source, so merges through the tree are stable.
+ */
+int lt_winner(const losertree_t *lt);
+
+/**
+ * Return the winner's key.
+ */
+static inline long lt_winner_key(const losertree_t *lt) {
+  return lt->key[0];
+}
+
+/**
+ * Replace the winner's key with its next one and replay its matches.
+ */
+void lt_replace(losertree_t *lt, long key);
+
+/**
+ * Mark the winner's source exhausted and replay its matches.
+ *
+ * The source stays exhausted until lt_set() is called for it again, so a
+ * tree can be rebuilt for another merge with only some sources set.
+ */
+void lt_exhaust(losertree_t *lt);
+
+#endif
@@ -0,0 +1,152 @@
+/**
+ * Parallel line sort.
+ *
+ * Sorts the lines of stdin in byte order, like LC_ALL=C sort, and prints
+ * them to stdout. The input is read into one buffer and the lines are
+ * sorted as references into it, so the text itself is never moved until it
+ * is written out.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include "sortio.h"
+#include "strsort.h"
+#include "topology.h"
+
+/** Bytes read from stdin at a time. */
+#define READ_BLOCK (1 << 20)
+
+/** Size of the output buffer. */
+#define WRITE_BUFFER (1 << 20)
+
+/** The number of threads to be used for sorting. Default: 1 */
+int thread_count = 1;
+
+
+/**
+ * Read all of stdin into a malloc'd buffer, setting *size to its length.
+ */
+static char *read_all(size_t *size) {
+  size_t cap = 16 * READ_BLOCK;
+  size_t len = 0;
+  char *buf = malloc(cap);
+  assert(buf != NULL);
+  for (;;) {
+    if (cap - len < READ_BLOCK) {
+      cap *= 2;
+      buf = realloc(buf, cap);
+      assert(buf != NULL);
+    }
+    size_t n = fread(&buf[len], 1, READ_BLOCK, stdin);
+    if (n == 0) {
+      break;
+    }
+    len += n;
+  }
+  *size = len;
+  return buf;
+}
+
+
+/**
+ * Split the buffer into lines, without their newlines. A last line without
+ * a newline still counts. Returns a malloc'd array and sets *count.
+ */
+static str_ref_t *split_lines(const char *buf, size_t size, size_t *count) {
+  size_t n = 0;
+  for (const char *p = buf; (p = memchr(p, '\n', buf + size - p)) != NULL; p++) {
+    n++;
+  }
+  if (size > 0 && buf[size - 1] != '\n') {
+    n++;
+  }
+
+  str_ref_t *refs = malloc((n > 0 ? n : 1) * sizeof(str_ref_t));
+  assert(refs != NULL);
+  const char *line = buf;
+  for (size_t i = 0; i < n; i++) {
+    const char *nl = memchr(line, '\n', buf + size - line);
+    size_t len = nl != NULL ? (size_t) (nl - line) : (size_t) (buf + size - line);
+    refs[i].str = line;
+    refs[i].len = len;
+    line += len + 1;
+  }
+  *count = n;
+  return refs;
+}
+
+
+/**
+ * Write the lines in order through one large buffer.
+ */
+static void write_lines(const str_ref_t *refs, size_t count) {
+  char *out = malloc(WRITE_BUFFER);
+  assert(out != NULL);
+  size_t used = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (used + refs[i].len + 1 > WRITE_BUFFER) {
+      fwrite(out, 1, used, stdout);
+      used = 0;
+    }
+    // lines longer than the buffer go out directly
+    if (refs[i].len + 1 > WRITE_BUFFER) {
+      fwrite(refs[i].str, 1, refs[i].len, stdout);
+      fputc('\n', stdout);
+      continue;
+    }
+    memcpy(&out[used], refs[i].str, refs[i].len);
+    used += refs[i].len;
+    out[used++] = '\n';
+  }
+  fwrite(out, 1, used, stdout);
+  free(out);
+}
+
+
+int main(int argc, char **argv) {
+  if (argc != 1) {
+    fprintf(stderr, "Usage: %s < input\n", argv[0]);
+    return 1;
+  }
+
+  struct timeval begin, end;
+
+  // get the number of threads from the environment variable MSORT_THREADS
+  thread_count = topo_thread_count(thread_count);
+  topo_pin(0);
+
+  log("Running with %d thread(s). Reading input.\n", thread_count);
+
+  // Read the input
+  gettimeofday(&begin, 0);
+  size_t size;
+  char *buf = read_all(&size);
+  size_t count;
+  str_ref_t *refs = split_lines(buf, size, &count);
+  gettimeofday(&end, 0);
+
+  log("Array read in %f seconds, %zu lines, beginning sort.\n",
+      time_in_secs(&begin, &end), count);
+
+  // Sort the lines
+  gettimeofday(&begin, 0);
+  strsort(refs, count, thread_count);
+  gettimeofday(&end, 0);
+
+  log("Sorting completed in %f seconds.\n", time_in_secs(&begin, &end));
+
+  // Print the result
+  gettimeofday(&begin, 0);
+  write_lines(refs, count);
+  gettimeofday(&end, 0);
+
+  log("Array printed in %f seconds.\n", time_in_secs(&begin, &end));
+
+  free(refs);
+  free(buf);
+
+  return 0;
+}
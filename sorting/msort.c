@@ -1,7 +1,8 @@
 /**
  * Simple, single-threaded merge sort.
  *
- * Do not modify this file so you can use it to check the tmsort implementation.
+ * A thin front-end over the psort library running on one thread, so it can
+ * be used to check the other tmsort engines.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,141 +11,34 @@
 
 #include <unistd.h>
 
-#include <assert.h>
-
-#define tty_printf(...) (isatty(1) && isatty(0) ? printf(__VA_ARGS__) : 0)
-
-#ifndef SHUSH
-#define log(...) (fprintf(stderr, __VA_ARGS__))
-#else 
-#define log(...)
-#endif
+#include "sortio.h"
+#include "psort.h"
+#include "topology.h"
 
 /** The number of threads to be used for sorting. Default: 1 */
 int thread_count = 1;
 
-/**
- * Compute the delta between the given timevals in seconds.
- */
-double time_in_secs(const struct timeval *begin, const struct timeval *end) {
-  long s = end->tv_sec - begin->tv_sec;
-  long ms = end->tv_usec - begin->tv_usec;
-  return s + ms * 1e-6;
-}
-
-/**
- * Print the given array of longs, an element per line.
- */
-void print_long_array(const long *array, int count) {
-  for (int i = 0; i < count; ++i) {
-    printf("%ld\n", array[i]);
-  }
-}
-
-/**
- * Merge two slices of nums into the corresponding portion of target.
- */
-void merge(long nums[], int from, int mid, int to, long target[]) {
-  int left = from;
-  int right = mid;
-
-  int i = from;
-  for (; i < to && left < mid && right < to; i++) {
-    if (nums[left] <= nums[right]) {
-      target[i] = nums[left];
-      left++;
-    }
-    else {
-      target[i] = nums[right];
-      right++;
-    }
-  }
-  if (left < mid) {
-    memmove(&target[i], &nums[left], (mid - left) * sizeof(long));
-  }
-  else if (right < to) {
-    memmove(&target[i], &nums[right], (to - right) * sizeof(long));
-  }
-
-}
-
-
-/**
- * Sort the given slice of nums into target.
- *
- * Warning: nums gets overwritten.
- */
-void merge_sort_aux(long nums[], int from, int to, long target[]) {
-  if (to - from <= 1) {
-    return;
-  }
-
-  int mid = (from + to) / 2;
-  merge_sort_aux(target, from, mid, nums);
-  merge_sort_aux(target, mid, to, nums);
-  merge(nums, from, mid, to, target);
-}
-
-
-/**
- * Sort the given array and return the sorted version.
- *
- * The result is malloc'd so it is the caller's responsibility to free it.
- *
- * Warning: The source array gets overwritten.
- */
-long *merge_sort(long nums[], int count) {
-  long *result = calloc(count, sizeof(long));
-  assert(result != NULL);
-
-  memmove(result, nums, count * sizeof(long));
-
-  merge_sort_aux(nums, 0, count, result);
-
-  return result;
-}
-
-/**
- * Based on command line arguments, allocate and populate an input and a 
- * helper array.
- *
- * Returns the number of elements in the array.
- */
-int allocate_load_array(int argc, char **argv, long **array) {
-  assert(argc > 1);
-  int count = atoi(argv[1]);
-
-  *array = calloc(count, sizeof(long));
-  assert(*array != NULL);
-
-  long element;
-  tty_printf("Enter %d elements, separated by whitespace\n", count);
-  int i = 0;
-  while (i < count && scanf("%ld", &element) != EOF)  {
-    (*array)[i++] = element;
-  }
-
-  return count;
-}
-
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    fprintf(stderr, "Usage: %s <n>\n", argv[0]);
+  // -l sorts with a half-size buffer instead of a full copy
+  int lowmem = argc == 3 && strcmp(argv[1], "-l") == 0;
+  if (argc != 2 + lowmem) {
+    fprintf(stderr, "Usage: %s [-l] <n>\n", argv[0]);
     return 1;
   }
+  argc -= lowmem;
+  argv += lowmem;
 
   struct timeval begin, end;
 
-  // get the number of threads from the environment variable SORT_THREADS
-  if (getenv("MSORT_THREADS") != NULL)
-    thread_count = atoi(getenv("MSORT_THREADS"));
+  // get the number of threads from the environment variable MSORT_THREADS
+  thread_count = topo_thread_count(thread_count);
 
   log("Running with %d thread(s). Reading input.\n", thread_count);
 
   // Read the input
   gettimeofday(&begin, 0);
   long *array = NULL;
-  int count = allocate_load_array(argc, argv, &array);
+  long count = allocate_load_array(argc, argv, &array, 1);
   gettimeofday(&end, 0);
 
   log("Array read in %f seconds, beginning sort.\n", 
@@ -152,7 +46,13 @@ int main(int argc, char **argv) {
  
   // Sort the array
   gettimeofday(&begin, 0);
-  long *result = merge_sort(array, count);
+  long *result = array;
+  if (lowmem) {
+    psort_long_lowmem(array, count, 1);
+  }
+  else {
+    result = psort_long_copy(array, count, 1);
+  }
   gettimeofday(&end, 0);
   
   log("Sorting completed in %f seconds.\n", time_in_secs(&begin, &end));
@@ -163,9 +63,12 @@ int main(int argc, char **argv) {
   gettimeofday(&end, 0);
   
   log("Array printed in %f seconds.\n", time_in_secs(&begin, &end));
+  log("Peak memory use %ld MB.\n", peak_rss_mb());
 
+  if (result != array) {
+    free(result);
+  }
   free(array);
-  free(result);
 
   return 0;
 }
@@ -0,0 +1,337 @@
+/**
+ * Multiway merge sort that streams the data through memory only a few times.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "tmsort.h"
+#include "psort.h"
+#include "multiway.h"
+#include "kernels.h"
+#include "losertree.h"
+#include "topology.h"
+#include "profile.h"
+
+/** Block size used when the L2 size is unknown, in elements (512 KB). */
+#define DEFAULT_BLOCK (64 * 1024)
+
+// One unit of work for the thread pool
+typedef struct mw_job {
+  int first;   // first run of the group (merge jobs) or the block (sort jobs)
+  int ways;    // number of runs in the group
+  long from;   // first output rank of this job within the group
+  long to;     // one past the last output rank
+} mw_job;
+
+// State shared by the workers of one phase
+typedef struct mw_shared {
+  long *src;
+  long *dst;
+  const long *bounds;   // run boundaries, one more than the number of runs
+  mw_job *jobs;
+  int njobs;
+  int next;             // next job to hand out
+  int slots;            // topology slots handed to workers so far
+  pthread_mutex_t lock;
+  void (*work)(struct mw_shared *, mw_job *);
+} mw_shared;
+
+
+/**
+ * Number of elements in the first n elements of run that are < key
+ * (or <= key if inclusive is set).
+ */
+static long bound(const long *run, long n, long key, int inclusive) {
+  long lo = 0;
+  long hi = n;
+  while (lo < hi) {
+    long mid = lo + (hi - lo) / 2;
+    if (run[mid] < key || (inclusive && run[mid] == key)) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+
+// Find where the rank-th smallest element splits a set of sorted runs.
+void multiway_split(const long *const *runs, const long *lens, int k,
+                    long rank, long *pos) {
+  long total = 0;
+  long lo = LONG_MAX;
+  long hi = LONG_MIN;
+  for (int i = 0; i < k; i++) {
+    total += lens[i];
+    if (lens[i] > 0) {
+      lo = runs[i][0] < lo ? runs[i][0] : lo;
+      hi = runs[i][lens[i] - 1] > hi ? runs[i][lens[i] - 1] : hi;
+    }
+  }
+  if (rank <= 0 || rank >= total) {
+    for (int i = 0; i < k; i++) {
+      pos[i] = rank <= 0 ? 0 : lens[i];
+    }
+    return;
+  }
+
+  // binary search the key space for the rank-th smallest element: the
+  // smallest key with at least rank elements <= it
+  while (lo < hi) {
+    long mid = lo + (long) (((unsigned long) hi - (unsigned long) lo) / 2);
+    long le = 0;
+    for (int i = 0; i < k; i++) {
+      le += bound(runs[i], lens[i], mid, 1);
+    }
+    if (le >= rank) {
+      hi = mid;
+    }
+    else {
+      lo = mid + 1;
+    }
+  }
+
+  // take everything smaller, then hand out the ties run by run
+  long need = rank;
+  for (int i = 0; i < k; i++) {
+    pos[i] = bound(runs[i], lens[i], lo, 0);
+    need -= pos[i];
+  }
+  for (int i = 0; i < k && need > 0; i++) {
+    long ties = bound(runs[i], lens[i], lo, 1) - pos[i];
+    long take = ties < need ? ties : need;
+    pos[i] += take;
+    need -= take;
+  }
+}
+
+
+/**
+ * Sort one block of the input in place.
+ */
+static void sort_job(mw_shared *sh, mw_job *job) {
+  long from = sh->bounds[job->first];
+  long to = sh->bounds[job->first + 1];
+  PROF_BEGIN(span, "multiway block sort", 0);
+  sort_run(&sh->src[from], &sh->dst[from], to - from);
+  PROF_END(span, 2 * (to - from) * sizeof(long));
+}
+
+
+/**
+ * Merge the job's slice of a group of runs through a loser tree.
+ */
+static void merge_job(mw_shared *sh, mw_job *job) {
+  int k = job->ways;
+  const long **runs = malloc(k * sizeof(long *));
+  long *lens = malloc(k * sizeof(long));
+  long *cur = malloc(k * sizeof(long));
+  long *end = malloc(k * sizeof(long));
+  assert(runs != NULL && lens != NULL && cur != NULL && end != NULL);
+
+  for (int i = 0; i < k; i++) {
+    runs[i] = &sh->src[sh->bounds[job->first + i]];
+    lens[i] = sh->bounds[job->first + i + 1] - sh->bounds[job->first + i];
+  }
+  multiway_split(runs, lens, k, job->from, cur);
+  multiway_split(runs, lens, k, job->to, end);
+
+  losertree_t lt;
+  lt_init(&lt, k);
+  for (int i = 0; i < k; i++) {
+    if (cur[i] < end[i]) {
+      lt_set(&lt, i, runs[i][cur[i]]);
+    }
+  }
+  lt_build(&lt);
+
+  PROF_BEGIN(span, "multiway merge", 1);
+  long *out = &sh->dst[sh->bounds[job->first] + job->from];
+  int src;
+  while ((src = lt_winner(&lt)) != -1) {
+    *out++ = lt_winner_key(&lt);
+    if (++cur[src] < end[src]) {
+      lt_replace(&lt, runs[src][cur[src]]);
+    }
+    else {
+      lt_exhaust(&lt);
+    }
+  }
+
+  PROF_END(span, 2 * (job->to - job->from) * sizeof(long));
+
+  lt_free(&lt);
+  free(runs);
+  free(lens);
+  free(cur);
+  free(end);
+}
+
+
+/**
+ * Take jobs from the shared list until it runs dry.
+ */
+static void *mw_worker(void *arg) {
+  mw_shared *sh = arg;
+  pthread_mutex_lock(&sh->lock);
+  topo_pin(sh->slots++);
+  pthread_mutex_unlock(&sh->lock);
+  for (;;) {
+    pthread_mutex_lock(&sh->lock);
+    int j = sh->next++;
+    pthread_mutex_unlock(&sh->lock);
+    if (j >= sh->njobs) {
+      return NULL;
+    }
+    sh->work(sh, &sh->jobs[j]);
+  }
+}
+
+
+/**
+ * Run every job of a phase on the given number of threads.
+ */
+static void run_phase(mw_shared *sh, int threads) {
+  sh->next = 0;
+  sh->slots = 0;
+  pthread_t *tids = malloc(threads * sizeof(pthread_t));
+  assert(tids != NULL);
+  for (int t = 1; t < threads; t++) {
+    pthread_create(&tids[t], NULL, mw_worker, sh);
+  }
+  mw_worker(sh);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+  free(tids);
+}
+
+
+/**
+ * Pick a block size so a block and its scratch space fit in the L2 cache.
+ */
+static long block_size(void) {
+  if (getenv("MSORT_BLOCK") != NULL && atol(getenv("MSORT_BLOCK")) > 0) {
+    return atol(getenv("MSORT_BLOCK"));
+  }
+  return topo_cache_bytes(2, DEFAULT_BLOCK * 2 * sizeof(long)) / (2 * sizeof(long));
+}
+
+
+/**
+ * Log how long a phase took and the memory bandwidth it implies.
+ */
+static void log_traffic(const char *phase, double secs, double bytes) {
+  log("%s in %f seconds, %.2f GB moved (%.2f GB/s).\n",
+      phase, secs, bytes / 1e9, secs > 0 ? bytes / 1e9 / secs : 0.0);
+}
+
+
+// Sort the given array with a multiway merge sort.
+long *multiway_sort(long nums[], long count, int threads) {
+  struct timeval begin, end;
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  long *result = psort_alloc(count * sizeof(long), threads);
+  assert(result != NULL);
+
+  // blocks grow past the cache size if there would be too many to number
+  size_t block = block_size();
+  if (((size_t) count + block - 1) / block > INT_MAX) {
+    block = ((size_t) count + INT_MAX - 1) / INT_MAX;
+  }
+  int k = ((size_t) count + block - 1) / block;
+  long *bounds = malloc((k + 1) * sizeof(long));
+  assert(bounds != NULL);
+  for (int i = 0; i <= k; i++) {
+    bounds[i] = (size_t) i * block < (size_t) count ? (long) (i * block) : count;
+  }
+
+  mw_shared sh;
+  pthread_mutex_init(&sh.lock, NULL);
+  sh.jobs = malloc(((long) k + (long) threads * k) * sizeof(mw_job) + sizeof(mw_job));
+  assert(sh.jobs != NULL);
+
+  // sort the blocks in place, with result as scratch
+  gettimeofday(&begin, 0);
+  sh.src = nums;
+  sh.dst = result;
+  sh.bounds = bounds;
+  sh.work = sort_job;
+  sh.njobs = k;
+  for (int i = 0; i < k; i++) {
+    sh.jobs[i].first = i;
+  }
+  run_phase(&sh, threads);
+  gettimeofday(&end, 0);
+  log_traffic("Sorted blocks", time_in_secs(&begin, &end), 2.0 * count * sizeof(long));
+
+  // merge groups of at most MULTIWAY_MAX_WAYS runs until one is left
+  long *src = nums;
+  long *dst = result;
+  int passes = 0;
+  while (k > 1) {
+    gettimeofday(&begin, 0);
+    int ways = k <= MULTIWAY_MAX_WAYS ? k : MULTIWAY_MAX_WAYS;
+    int groups = (k + ways - 1) / ways;
+
+    // split every group's output evenly across the threads
+    sh.njobs = 0;
+    for (int g = 0; g < groups; g++) {
+      int first = g * ways;
+      int n_ways = first + ways <= k ? ways : k - first;
+      long len = bounds[first + n_ways] - bounds[first];
+      for (int t = 0; t < threads; t++) {
+        mw_job *job = &sh.jobs[sh.njobs++];
+        job->first = first;
+        job->ways = n_ways;
+        job->from = len * t / threads;
+        job->to = len * (t + 1) / threads;
+      }
+    }
+    sh.src = src;
+    sh.dst = dst;
+    sh.work = merge_job;
+    run_phase(&sh, threads);
+
+    // the merged groups become the runs of the next pass
+    for (int g = 0; g < groups; g++) {
+      bounds[g] = bounds[g * ways];
+    }
+    bounds[groups] = count;
+    k = groups;
+
+    long *swap = src;
+    src = dst;
+    dst = swap;
+    passes++;
+
+    gettimeofday(&end, 0);
+    log_traffic("Merged runs", time_in_secs(&begin, &end), 2.0 * count * sizeof(long));
+  }
+
+  if (src != result) {
+    memcpy(result, src, count * sizeof(long));
+  }
+
+  // a binary merge sort would stream the array through memory once per level
+  int binary_passes = 0;
+  for (long width = SMALL_SORT_MAX; width < count; width *= 2) {
+    binary_passes++;
+  }
+  log("Multiway: blocks of %zu, %d merge pass(es); binary merge sort makes %d.\n",
+      block, passes, binary_passes);
+
+  pthread_mutex_destroy(&sh.lock);
+  free(sh.jobs);
+  free(bounds);
+  return result;
+}
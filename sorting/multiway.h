@@ -0,0 +1,42 @@
+/**
+ * Multiway merge sort that streams the data through memory only a few times.
+ */
+#ifndef MULTIWAY_H
+#define MULTIWAY_H
+
+/** Most runs merged by one loser tree before an extra pass is added. */
+#define MULTIWAY_MAX_WAYS 1024
+
+/**
+ * Sort the given array with a multiway merge sort and return the sorted
+ * version.
+ *
+ * Threads first sort blocks sized to the L2 cache, then the blocks are merged
+ * through loser trees, normally in a single pass. Every thread merges its own
+ * slice of the output, found by multisequence selection, so the final merge
+ * is parallel too. The memory traffic of each phase is logged. MSORT_BLOCK
+ * overrides the block size (in elements).
+ *
+ * The result is malloc'd so it is the caller's responsibility to free it.
+ *
+ * Warning: The source array gets overwritten.
+ */
+long *multiway_sort(long nums[], long count, int threads);
+
+/**
+ * Find where the rank-th smallest element splits a set of sorted runs.
+ *
+ * On return pos[i] is the number of elements of runs[i] that precede the
+ * split, every element before the split is <= every element after it, and
+ * the positions sum to rank. Equal keys are assigned to earlier runs first.
+ *
+ * @param runs The sorted runs.
+ * @param lens Length of each run.
+ * @param k Number of runs.
+ * @param rank Number of elements that should precede the split.
+ * @param pos Output, k positions.
+ */
+void multiway_split(const long *const *runs, const long *lens, int k,
+                    long rank, long *pos);
+
+#endif
@@ -0,0 +1,331 @@
+/**
+ * Pipelined read, sort and print for tmsort.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "tmsort.h"
+#include "psort.h"
+#include "kernels.h"
+#include "losertree.h"
+#include "aggregate.h"
+#include "pipeline.h"
+#include "topology.h"
+
+/** Output blocks in flight between the merge and the formatter. */
+#define PIPELINE_BLOCKS 4
+
+// Chunks waiting to be sorted, filled by the reader
+typedef struct sort_queue {
+  long *nums;
+  long *counts;     // run lengths of the collapsed chunks when counting
+  long *lens;       // elements left in each chunk after sorting
+  aggregate_t aggregate;
+  long queued;      // elements in complete chunks
+  long taken;       // elements handed to workers
+  int done;         // no more input
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+} sort_queue;
+
+// Helper struct to pass custom arguments to pthread_create
+typedef struct sort_worker_args {
+  sort_queue *queue;
+  int slot;
+} sort_worker_args;
+
+// A ring of output blocks between the merge and the formatter
+typedef struct block_ring {
+  long *blocks[PIPELINE_BLOCKS];
+  long *counts[PIPELINE_BLOCKS];  // only when counting
+  long lens[PIPELINE_BLOCKS];
+  long len;         // elements in the block the merge is filling
+  long filled;      // blocks the merge has completed
+  long printed;     // blocks the formatter has written
+  int done;         // the merge has finished
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+} block_ring;
+
+
+/**
+ * Sort chunks from the queue until the input ends and none are left.
+ */
+static void *sort_worker(void *arg_in) {
+  sort_worker_args *arg = arg_in;
+  sort_queue *q = arg->queue;
+  topo_pin(arg->slot);
+
+  long *tmp = malloc(PIPELINE_CHUNK * sizeof(long));
+  assert(tmp != NULL);
+  for (;;) {
+    pthread_mutex_lock(&q->lock);
+    while (q->taken == q->queued && !q->done) {
+      pthread_cond_wait(&q->ready, &q->lock);
+    }
+    if (q->taken == q->queued) {
+      pthread_mutex_unlock(&q->lock);
+      break;
+    }
+    long from = q->taken;
+    long to = q->queued;
+    if (to - from > PIPELINE_CHUNK) {
+      to = from + PIPELINE_CHUNK;
+    }
+    q->taken = to;
+    pthread_mutex_unlock(&q->lock);
+
+    sort_run(&q->nums[from], tmp, to - from);
+
+    // collapse duplicates within the chunk so the merge sees fewer elements
+    long len = to - from;
+    if (q->aggregate != AGGREGATE_NONE) {
+      len = aggregate_run(&q->nums[from], q->counts != NULL ? &q->counts[from] : NULL, len);
+    }
+    q->lens[from / PIPELINE_CHUNK] = len;
+  }
+  free(tmp);
+  return NULL;
+}
+
+
+/**
+ * Format and write blocks as the merge fills them.
+ */
+static void *formatter(void *arg) {
+  block_ring *ring = arg;
+  char *text = malloc(PIPELINE_BLOCK * FORMATTED_COUNTED_MAX);
+  assert(text != NULL);
+  for (;;) {
+    pthread_mutex_lock(&ring->lock);
+    while (ring->printed == ring->filled && !ring->done) {
+      pthread_cond_wait(&ring->changed, &ring->lock);
+    }
+    if (ring->printed == ring->filled) {
+      pthread_mutex_unlock(&ring->lock);
+      break;
+    }
+    int b = ring->printed % PIPELINE_BLOCKS;
+    pthread_mutex_unlock(&ring->lock);
+
+    size_t bytes = ring->counts[b] != NULL
+        ? format_counted_array(ring->blocks[b], ring->counts[b], ring->lens[b], text)
+        : format_long_array(ring->blocks[b], ring->lens[b], text);
+    fwrite(text, 1, bytes, stdout);
+
+    pthread_mutex_lock(&ring->lock);
+    ring->printed++;
+    pthread_cond_signal(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+  }
+  free(text);
+  return NULL;
+}
+
+
+/**
+ * Hand the filled block to the formatter and wait for a free one.
+ */
+static void next_block(block_ring *ring) {
+  pthread_mutex_lock(&ring->lock);
+  ring->lens[ring->filled % PIPELINE_BLOCKS] = ring->len;
+  ring->filled++;
+  ring->len = 0;
+  pthread_cond_signal(&ring->changed);
+  while (ring->filled - ring->printed == PIPELINE_BLOCKS) {
+    pthread_cond_wait(&ring->changed, &ring->lock);
+  }
+  pthread_mutex_unlock(&ring->lock);
+}
+
+
+/**
+ * Append an element and its count to the block the merge is filling.
+ */
+static inline void emit(block_ring *ring, long key, long count) {
+  // only the merge changes filled, so it can read it without the lock
+  int b = ring->filled % PIPELINE_BLOCKS;
+  ring->blocks[b][ring->len] = key;
+  if (ring->counts[b] != NULL) {
+    ring->counts[b][ring->len] = count;
+  }
+  if (++ring->len == PIPELINE_BLOCK) {
+    next_block(ring);
+  }
+}
+
+
+/**
+ * Merge the sorted chunks of the queue into the ring, collapsing equal keys
+ * from different chunks when aggregating.
+ */
+static void merge_chunks(const sort_queue *q, long n, block_ring *ring) {
+  const long *nums = q->nums;
+  int k = (n + PIPELINE_CHUNK - 1) / PIPELINE_CHUNK;
+  long *cur = malloc((k > 0 ? k : 1) * sizeof(long));
+  long *end = malloc((k > 0 ? k : 1) * sizeof(long));
+  assert(cur != NULL && end != NULL);
+
+  losertree_t lt;
+  lt_init(&lt, k > 0 ? k : 1);
+  for (int i = 0; i < k; i++) {
+    cur[i] = i * PIPELINE_CHUNK;
+    end[i] = cur[i] + q->lens[i];
+    lt_set(&lt, i, nums[cur[i]]);
+  }
+  lt_build(&lt);
+
+  // when aggregating, a key is only emitted once the next one differs
+  int pending = 0;
+  long key = 0;
+  long count = 0;
+  int src;
+  while ((src = lt_winner(&lt)) != -1) {
+    long x = lt_winner_key(&lt);
+    long c = q->counts != NULL ? q->counts[cur[src]] : 1;
+    if (q->aggregate == AGGREGATE_NONE) {
+      emit(ring, x, c);
+    }
+    else if (pending && x == key) {
+      count += c;
+    }
+    else {
+      if (pending) {
+        emit(ring, key, count);
+      }
+      pending = 1;
+      key = x;
+      count = c;
+    }
+    if (++cur[src] < end[src]) {
+      lt_replace(&lt, nums[cur[src]]);
+    }
+    else {
+      lt_exhaust(&lt);
+    }
+  }
+  if (pending) {
+    emit(ring, key, count);
+  }
+  if (ring->len > 0) {
+    next_block(ring);
+  }
+
+  pthread_mutex_lock(&ring->lock);
+  ring->done = 1;
+  pthread_cond_signal(&ring->changed);
+  pthread_mutex_unlock(&ring->lock);
+
+  lt_free(&lt);
+  free(cur);
+  free(end);
+}
+
+
+// Read, sort and print up to count longs with the phases overlapped.
+int pipelined_sort(long count, int threads, aggregate_t aggregate) {
+  struct timeval begin, end;
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  sort_queue q;
+  q.nums = psort_alloc(count * sizeof(long), threads);
+  assert(q.nums != NULL);
+  q.counts = NULL;
+  if (aggregate == AGGREGATE_COUNT) {
+    q.counts = psort_alloc(count * sizeof(long), threads);
+    assert(q.counts != NULL);
+  }
+  q.lens = malloc((count / PIPELINE_CHUNK + 1) * sizeof(long));
+  assert(q.lens != NULL);
+  q.aggregate = aggregate;
+  q.queued = q.taken = 0;
+  q.done = 0;
+  pthread_mutex_init(&q.lock, NULL);
+  pthread_cond_init(&q.ready, NULL);
+
+  // the reader takes one core, the sort workers get the others
+  int workers = threads > 1 ? threads - 1 : 1;
+  sort_worker_args *args = malloc(workers * sizeof(sort_worker_args));
+  pthread_t *tids = malloc(workers * sizeof(pthread_t));
+  assert(args != NULL && tids != NULL);
+  for (int t = 0; t < workers; t++) {
+    args[t].queue = &q;
+    args[t].slot = t + 1;
+    pthread_create(&tids[t], NULL, sort_worker, &args[t]);
+  }
+
+  gettimeofday(&begin, 0);
+  tty_printf("Enter %ld elements, separated by whitespace\n", count);
+  long_reader_t reader;
+  long_reader_init(&reader, stdin);
+  long n = 0;
+  while (n < count && long_reader_next(&reader, &q.nums[n])) {
+    n++;
+    if (n % PIPELINE_CHUNK == 0) {
+      pthread_mutex_lock(&q.lock);
+      q.queued = n;
+      pthread_cond_signal(&q.ready);
+      pthread_mutex_unlock(&q.lock);
+    }
+  }
+  long_reader_free(&reader);
+
+  pthread_mutex_lock(&q.lock);
+  q.queued = n;
+  q.done = 1;
+  pthread_cond_broadcast(&q.ready);
+  pthread_mutex_unlock(&q.lock);
+  gettimeofday(&end, 0);
+  log("Array read in %f seconds, sorting chunks as they arrive.\n",
+      time_in_secs(&begin, &end));
+
+  for (int t = 0; t < workers; t++) {
+    pthread_join(tids[t], NULL);
+  }
+  gettimeofday(&end, 0);
+  log("Chunks sorted by %f seconds.\n", time_in_secs(&begin, &end));
+
+  // merge while the formatter prints
+  block_ring ring;
+  for (int b = 0; b < PIPELINE_BLOCKS; b++) {
+    ring.blocks[b] = malloc(PIPELINE_BLOCK * sizeof(long));
+    assert(ring.blocks[b] != NULL);
+    ring.counts[b] = NULL;
+    if (aggregate == AGGREGATE_COUNT) {
+      ring.counts[b] = malloc(PIPELINE_BLOCK * sizeof(long));
+      assert(ring.counts[b] != NULL);
+    }
+  }
+  ring.filled = ring.printed = 0;
+  ring.len = 0;
+  ring.done = 0;
+  pthread_mutex_init(&ring.lock, NULL);
+  pthread_cond_init(&ring.changed, NULL);
+
+  pthread_t printer;
+  pthread_create(&printer, NULL, formatter, &ring);
+  merge_chunks(&q, n, &ring);
+  pthread_join(printer, NULL);
+  fflush(stdout);
+  gettimeofday(&end, 0);
+  log("Merged and printed by %f seconds.\n", time_in_secs(&begin, &end));
+
+  for (int b = 0; b < PIPELINE_BLOCKS; b++) {
+    free(ring.blocks[b]);
+    free(ring.counts[b]);
+  }
+  pthread_mutex_destroy(&ring.lock);
+  pthread_cond_destroy(&ring.changed);
+  pthread_mutex_destroy(&q.lock);
+  pthread_cond_destroy(&q.ready);
+  free(q.nums);
+  free(q.counts);
+  free(q.lens);
+  free(args);
+  free(tids);
+  return 0;
+}
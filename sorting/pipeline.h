@@ -0,0 +1,38 @@
+/**
+ * Pipelined read, sort and print for tmsort.
+ */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "aggregate.h"
+
+/** Elements per input chunk, each sorted as soon as it has been parsed. */
+#define PIPELINE_CHUNK (1L << 20)
+
+/** Elements per output block handed from the merge to the formatter. */
+#define PIPELINE_BLOCK (1L << 16)
+
+/**
+ * Read up to count longs from stdin and print them sorted, overlapping the
+ * three phases instead of running them one after the other.
+ *
+ * The main thread parses the input into chunks of PIPELINE_CHUNK elements
+ * and queues each one for the sort workers as soon as it is complete, so
+ * sorting proceeds while the rest is still being read. The sorted chunks
+ * are then merged through a loser tree in blocks of PIPELINE_BLOCK
+ * elements, which a formatter thread turns into text and writes out while
+ * the merge goes on.
+ *
+ * When aggregating, every worker collapses the duplicates of its chunk right
+ * after sorting it, and the merge collapses equal keys across chunks, so
+ * only distinct values (and their counts) reach the formatter.
+ *
+ * @param count Number of elements to read.
+ * @param threads Number of threads to use.
+ * @param aggregate Whether to print all elements, distinct values only, or
+ *                  distinct values with counts.
+ * @return 0 on success.
+ */
+int pipelined_sort(long count, int threads, aggregate_t aggregate);
+
+#endif
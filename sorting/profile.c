@@ -0,0 +1,307 @@
+/**
+ * Optional profiling of the sorts, see profile.h.
+ */
+#ifdef MSORT_PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "sortio.h"
+#include "profile.h"
+
+/** Distinct span name and level pairs a thread can aggregate. */
+#define PROF_MAX_KEYS 64
+
+// Totals of the spans with one name and level
+typedef struct prof_total {
+  const char *name;
+  int level;
+  long count;
+  long ns;
+  long bytes;
+} prof_total_t;
+
+// A span kept for the trace
+typedef struct prof_event {
+  const char *name;
+  int level;
+  long start;
+  long end;
+  long bytes;
+} prof_event_t;
+
+// Everything one thread recorded
+typedef struct prof_thread {
+  int id;
+  long first;    // start of its first span
+  long last;     // end of its last span
+  long busy;
+  prof_total_t totals[PROF_MAX_KEYS];
+  int ntotals;
+  prof_event_t *events;
+  long nevents;
+  long cap;
+  struct prof_thread *next;
+} prof_thread_t;
+
+// A hardware counter opened by prof_start()
+typedef struct prof_counter {
+  const char *name;
+  unsigned int type;
+  unsigned long config;
+  int fd;
+} prof_counter_t;
+
+static prof_counter_t counters[] = {
+  {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1},
+  {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1},
+  {"llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1},
+};
+#define NCOUNTERS (sizeof(counters) / sizeof(counters[0]))
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static prof_thread_t *threads;
+static int nthreads;
+static __thread prof_thread_t *self;
+static long session_start;
+static long session_end;
+static long counter_values[NCOUNTERS];
+
+
+static long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+
+/**
+ * The calling thread's record, registering it on first use.
+ */
+static prof_thread_t *this_thread(void) {
+  if (self == NULL) {
+    self = calloc(1, sizeof(prof_thread_t));
+    assert(self != NULL);
+    pthread_mutex_lock(&registry_lock);
+    self->id = nthreads++;
+    self->next = threads;
+    threads = self;
+    pthread_mutex_unlock(&registry_lock);
+  }
+  return self;
+}
+
+
+static int open_counter(prof_counter_t *c) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = c->type;
+  attr.config = c->config;
+  attr.disabled = 1;
+  attr.inherit = 1;          // count the worker threads too
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+
+// Start the profiled section and the hardware counters.
+void prof_start(void) {
+  for (int i = 0; i < NCOUNTERS; i++) {
+    counters[i].fd = open_counter(&counters[i]);
+    if (counters[i].fd != -1) {
+      ioctl(counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  session_start = now_ns();
+}
+
+
+// End the profiled section.
+void prof_stop(void) {
+  session_end = now_ns();
+  for (int i = 0; i < NCOUNTERS; i++) {
+    if (counters[i].fd != -1) {
+      ioctl(counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(counters[i].fd, &counter_values[i], sizeof(long)) != sizeof(long)) {
+        counter_values[i] = -1;
+      }
+      close(counters[i].fd);
+    }
+  }
+}
+
+
+// Open a span of the calling thread.
+prof_span_t prof_begin(const char *name, int level) {
+  prof_span_t span = {name, level, now_ns()};
+  return span;
+}
+
+
+// Close a span, accounting bytes of memory traffic to it.
+void prof_end(const prof_span_t *span, long bytes) {
+  long end = now_ns();
+  long ns = end - span->start;
+  prof_thread_t *t = this_thread();
+
+  if (t->busy == 0 || span->start < t->first) {
+    t->first = span->start;
+  }
+  if (end > t->last) {
+    t->last = end;
+  }
+  t->busy += ns;
+
+  // names are string literals, so pointers identify them
+  prof_total_t *total = NULL;
+  for (int i = 0; i < t->ntotals; i++) {
+    if (t->totals[i].name == span->name && t->totals[i].level == span->level) {
+      total = &t->totals[i];
+      break;
+    }
+  }
+  if (total == NULL && t->ntotals < PROF_MAX_KEYS) {
+    total = &t->totals[t->ntotals++];
+    total->name = span->name;
+    total->level = span->level;
+  }
+  if (total != NULL) {
+    total->count++;
+    total->ns += ns;
+    total->bytes += bytes;
+  }
+
+  if (ns >= PROF_TRACE_MIN_NS) {
+    if (t->nevents == t->cap) {
+      t->cap = t->cap == 0 ? 256 : 2 * t->cap;
+      t->events = realloc(t->events, t->cap * sizeof(prof_event_t));
+      assert(t->events != NULL);
+    }
+    prof_event_t e = {span->name, span->level, span->start, end, bytes};
+    t->events[t->nevents++] = e;
+  }
+}
+
+
+/**
+ * Write the aggregated report.
+ */
+static void write_report(FILE *f) {
+  double wall = (session_end - session_start) * 1e-9;
+  fprintf(f, "{\n  \"wall_seconds\": %.6f,\n", wall);
+
+  // totals over all threads, per span name and level
+  prof_total_t all[PROF_MAX_KEYS];
+  int nall = 0;
+  long bytes = 0;
+  for (prof_thread_t *t = threads; t != NULL; t = t->next) {
+    for (int i = 0; i < t->ntotals; i++) {
+      prof_total_t *src = &t->totals[i];
+      int j = 0;
+      while (j < nall && (all[j].name != src->name || all[j].level != src->level)) {
+        j++;
+      }
+      if (j == nall) {
+        if (nall == PROF_MAX_KEYS) {
+          continue;
+        }
+        all[nall] = *src;
+        all[nall].count = all[nall].ns = all[nall].bytes = 0;
+        nall++;
+      }
+      all[j].count += src->count;
+      all[j].ns += src->ns;
+      all[j].bytes += src->bytes;
+      bytes += src->bytes;
+    }
+  }
+  fprintf(f, "  \"bytes_moved\": %ld,\n  \"spans\": [", bytes);
+  for (int i = 0; i < nall; i++) {
+    fprintf(f, "%s\n    {\"name\": \"%s\", \"level\": %d, \"count\": %ld, "
+            "\"seconds\": %.6f, \"bytes\": %ld}",
+            i == 0 ? "" : ",", all[i].name, all[i].level, all[i].count,
+            all[i].ns * 1e-9, all[i].bytes);
+  }
+  fprintf(f, "\n  ],\n  \"threads\": [");
+
+  // busy time is the sum of the spans, idle time the gaps between them,
+  // such as waiting for a thread to join
+  for (prof_thread_t *t = threads; t != NULL; t = t->next) {
+    fprintf(f, "%s\n    {\"id\": %d, \"busy_seconds\": %.6f, \"idle_seconds\": %.6f, "
+            "\"first_span\": %.6f, \"last_span\": %.6f}",
+            t == threads ? "" : ",", t->id, t->busy * 1e-9,
+            (t->last - t->first - t->busy) * 1e-9,
+            (t->first - session_start) * 1e-9, (t->last - session_start) * 1e-9);
+  }
+  fprintf(f, "\n  ],\n  \"counters\": {");
+
+  int first = 1;
+  for (int i = 0; i < NCOUNTERS; i++) {
+    if (counters[i].fd != -1 && counter_values[i] >= 0) {
+      fprintf(f, "%s\n    \"%s\": %ld", first ? "" : ",", counters[i].name, counter_values[i]);
+      first = 0;
+    }
+  }
+  fprintf(f, "\n  }\n}\n");
+}
+
+
+/**
+ * Write the spans as Chrome trace events, timestamps in microseconds.
+ */
+static void write_trace(FILE *f) {
+  fprintf(f, "{\"traceEvents\": [");
+  int first = 1;
+  for (prof_thread_t *t = threads; t != NULL; t = t->next) {
+    for (long i = 0; i < t->nevents; i++) {
+      prof_event_t *e = &t->events[i];
+      fprintf(f, "%s\n  {\"name\": \"%s\", \"cat\": \"level %d\", \"ph\": \"X\", "
+              "\"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, "
+              "\"args\": {\"level\": %d, \"bytes\": %ld}}",
+              first ? "" : ",", e->name, e->level, t->id,
+              (e->start - session_start) * 1e-3, (e->end - e->start) * 1e-3,
+              e->level, e->bytes);
+      first = 0;
+    }
+  }
+  fprintf(f, "\n]}\n");
+}
+
+
+// Write the report and the trace, logging their paths.
+void prof_write(const char *prefix) {
+  char path[4096];
+
+  snprintf(path, sizeof(path), "%s.json", prefix);
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+  write_report(f);
+  fclose(f);
+  log("Profile written to %s\n", path);
+
+  snprintf(path, sizeof(path), "%s.trace.json", prefix);
+  f = fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+  write_trace(f);
+  fclose(f);
+  log("Trace written to %s\n", path);
+}
+
+#endif
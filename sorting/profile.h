@@ -0,0 +1,65 @@
+/**
+ * Optional profiling of the sorts, enabled by building with MSORT_PROFILE
+ * defined (make PROFILE=1). Without it every macro here expands to nothing.
+ *
+ * Code marks units of work with spans:
+ *
+ *   PROF_BEGIN(span, "merge", level);
+ *   ...
+ *   PROF_END(span, bytes_moved);
+ *
+ * Spans of one thread must not nest; the sum of a thread's spans is its busy
+ * time. Spans are aggregated per name and level, and the ones long enough to
+ * see are also kept for a Chrome trace (chrome://tracing or Perfetto).
+ *
+ * prof_start() and prof_stop() bracket the sort; prof_write() then writes
+ * <prefix>.json, with time and bytes per span name and level, busy and idle
+ * time per thread and the hardware counters perf_event_open() could read,
+ * and <prefix>.trace.json with the timeline.
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#ifdef MSORT_PROFILE
+
+/** Spans shorter than this (in nanoseconds) only go into the totals. */
+#define PROF_TRACE_MIN_NS 50000
+
+typedef struct prof_span {
+  const char *name;
+  int level;
+  long start;
+} prof_span_t;
+
+/** Start the profiled section and the hardware counters. */
+void prof_start(void);
+
+/** End the profiled section. */
+void prof_stop(void);
+
+/** Write the report and the trace, logging their paths. */
+void prof_write(const char *prefix);
+
+/** Open a span of the calling thread. */
+prof_span_t prof_begin(const char *name, int level);
+
+/** Close a span, accounting bytes of memory traffic to it. */
+void prof_end(const prof_span_t *span, long bytes);
+
+#define PROF_BEGIN(span, name, level) prof_span_t span = prof_begin((name), (level))
+#define PROF_END(span, bytes) prof_end(&(span), (bytes))
+#define PROF_START() prof_start()
+#define PROF_STOP() prof_stop()
+#define PROF_WRITE(prefix) prof_write(prefix)
+
+#else
+
+#define PROF_BEGIN(span, name, level) ((void) 0)
+#define PROF_END(span, bytes) ((void) 0)
+#define PROF_START() ((void) 0)
+#define PROF_STOP() ((void) 0)
+#define PROF_WRITE(prefix) ((void) 0)
+
+#endif
+
+#endif
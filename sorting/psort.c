@@ -0,0 +1,136 @@
+/**
+ * Parallel merge sort library: thread budget and the standard
+ * instantiations of the sort template.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "psort.h"
+#include "kernels.h"
+#include "topology.h"
+
+// Take a thread from the budget.
+int psort_claim_thread(psort_budget_t *budget) {
+  pthread_mutex_lock(&budget->lock);
+  int ok = budget->spare > 0;
+  if (ok) {
+    budget->spare--;
+  }
+  pthread_mutex_unlock(&budget->lock);
+  return ok;
+}
+
+// Topology slot of the thread that sorts the elements starting at from.
+int psort_slot(const psort_budget_t *budget, size_t from) {
+  return budget->count == 0 ? 0 : (double) from / budget->count * budget->threads;
+}
+
+// Give a thread back to the budget.
+void psort_release_thread(psort_budget_t *budget) {
+  pthread_mutex_lock(&budget->lock);
+  budget->spare++;
+  pthread_mutex_unlock(&budget->lock);
+}
+
+// Helper struct to pass custom arguments to pthread_create
+typedef struct psort_touch {
+  char *from;
+  size_t bytes;
+  int slot;
+} psort_touch_t;
+
+static void *psort_touch_pages(void *arg) {
+  psort_touch_t *touch = arg;
+  topo_pin(touch->slot);
+  memset(touch->from, 0, touch->bytes);
+  return NULL;
+}
+
+// Allocate a large array backed by huge pages and first-touched in parallel.
+void *psort_alloc(size_t bytes, int threads) {
+  if (bytes < PSORT_HUGE_PAGE) {
+    return calloc(bytes > 0 ? bytes : 1, 1);
+  }
+
+  // whole huge pages, so the kernel can back all of the array with them
+  size_t size = (bytes + PSORT_HUGE_PAGE - 1) & ~(PSORT_HUGE_PAGE - 1);
+  void *mem;
+  if (posix_memalign(&mem, PSORT_HUGE_PAGE, size) != 0) {
+    return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  madvise(mem, size, MADV_HUGEPAGE);
+#endif
+
+  // split on huge page boundaries so no page is touched by two threads
+  if (threads < 1) {
+    threads = 1;
+  }
+  size_t pages = size / PSORT_HUGE_PAGE;
+  if ((size_t) threads > pages) {
+    threads = pages;
+  }
+  psort_touch_t *touch = malloc(threads * sizeof(psort_touch_t));
+  pthread_t *tids = malloc(threads * sizeof(pthread_t));
+  if (touch == NULL || tids == NULL) {
+    free(touch);
+    free(tids);
+    free(mem);
+    return NULL;
+  }
+  for (int t = 0; t < threads; t++) {
+    size_t first = pages * t / threads;
+    size_t last = pages * (t + 1) / threads;
+    touch[t].from = (char *) mem + first * PSORT_HUGE_PAGE;
+    touch[t].bytes = (last - first) * PSORT_HUGE_PAGE;
+    touch[t].slot = t;
+  }
+  for (int t = 1; t < threads; t++) {
+    pthread_create(&tids[t], NULL, psort_touch_pages, &touch[t]);
+  }
+  psort_touch_pages(&touch[0]);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+
+  free(touch);
+  free(tids);
+  return mem;
+}
+
+// longs go through the runtime-dispatched SIMD kernels
+static void merge_long(const long *a, size_t na, const long *b, size_t nb, long *out) {
+  merge_runs(a, na, b, nb, out);
+}
+
+static void small_long(long *nums, size_t count) {
+  small_sort(nums, count);
+}
+
+#define PSORT_NAME long
+#define PSORT_TYPE long
+#define PSORT_MERGE_KERNEL merge_long
+#define PSORT_SMALL_KERNEL small_long
+#define PSORT_TILE_KERNEL sort_run
+#define PSORT_TILE_COUNT kernels_tile()
+#include "psort_impl.h"
+
+#define PSORT_NAME i32
+#define PSORT_TYPE int32_t
+#include "psort_impl.h"
+
+#define PSORT_NAME u64
+#define PSORT_TYPE uint64_t
+#include "psort_impl.h"
+
+#define PSORT_NAME f64
+#define PSORT_TYPE double
+#include "psort_impl.h"
+
+#define PSORT_NAME kv
+#define PSORT_TYPE psort_kv_t
+#define PSORT_LESS(a, b) ((a).key < (b).key)
+#include "psort_impl.h"
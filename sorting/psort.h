@@ -0,0 +1,119 @@
+/**
+ * Parallel merge sort library.
+ *
+ * The sort is written once in psort_impl.h and specialized per element type
+ * at compile time, so comparisons are inlined instead of going through a
+ * qsort-style function pointer. This library ships these instantiations:
+ *
+ *   psort_long  long                     (SIMD merge and base-case kernels)
+ *   psort_i32   int32_t
+ *   psort_u64   uint64_t
+ *   psort_f64   double                   (NaNs have no defined position)
+ *   psort_kv    psort_kv_t records, ordered by key
+ *
+ * Any other element type, for example a fixed-size record, gets its own sort
+ * by defining the element type and ordering and including the template:
+ *
+ *   #define PSORT_NAME rec
+ *   #define PSORT_TYPE rec_t
+ *   #define PSORT_LESS(a, b) ((a).key < (b).key)
+ *   #include "psort_impl.h"
+ *
+ * which defines psort_rec(), psort_rec_copy(), psort_rec_lowmem() and
+ * psort_rec_argsort(). All sorts are stable.
+ */
+#ifndef PSORT_H
+#define PSORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/** Slices of at most this many elements are sorted by the base case. */
+#define PSORT_SMALL_MAX 16
+
+/** Allocations of at least this many bytes are backed by huge pages. */
+#define PSORT_HUGE_PAGE (2UL << 20)
+
+/** A 64-bit key with a 64-bit payload. */
+typedef struct psort_kv {
+  uint64_t key;
+  uint64_t value;
+} psort_kv_t;
+
+/**
+ * Threads a sort may still start, shared by all of its recursion levels.
+ *
+ * The thread sorting elements [from, to) runs in topology slot
+ * from * threads / count (see topology.h), so the halves a thread merges
+ * were sorted in neighbouring slots.
+ */
+typedef struct psort_budget {
+  int spare;
+  pthread_mutex_t lock;
+  size_t count;
+  int threads;
+} psort_budget_t;
+
+#define PSORT_BUDGET(count, threads) \
+  {(threads) > 1 ? (threads) - 1 : 0, PTHREAD_MUTEX_INITIALIZER, (count), (threads)}
+
+/**
+ * Topology slot of the thread that sorts the elements starting at from.
+ */
+int psort_slot(const psort_budget_t *budget, size_t from);
+
+/**
+ * Take a thread from the budget. Returns 1 if one was available.
+ */
+int psort_claim_thread(psort_budget_t *budget);
+
+/**
+ * Give a thread back to the budget.
+ */
+void psort_release_thread(psort_budget_t *budget);
+
+/**
+ * Allocate a zeroed array, returning NULL on failure. Free it with free().
+ *
+ * Arrays of at least PSORT_HUGE_PAGE bytes are aligned to huge pages and
+ * marked with MADV_HUGEPAGE, so that a multi-GB array needs a few thousand
+ * TLB entries instead of a million. Their pages are then zeroed by threads
+ * threads, each touching the slice it is likely to sort first, which on NUMA
+ * machines places the memory next to the threads using it.
+ */
+void *psort_alloc(size_t bytes, int threads);
+
+/**
+ * Declare the functions psort_impl.h defines for the given name and type:
+ *
+ * psort_<name>(data, count, threads) sorts data in place, using up to
+ * threads threads and a scratch buffer of count elements.
+ *
+ * psort_<name>_copy(nums, count, threads) returns a malloc'd sorted copy of
+ * nums and uses nums itself as the scratch buffer, so nums gets overwritten.
+ *
+ * psort_<name>_lowmem(data, count, threads) sorts data in place like
+ * psort_<name>() but with a scratch buffer of only count / 2 elements, so
+ * peak memory is 1.5 instead of 2 times the data. The two halves are sorted
+ * one after the other, each with all the threads, and the final merge works
+ * in place.
+ *
+ * psort_<name>_argsort(keys, count, perm, threads) sorts keys in place and
+ * sets perm[i] to the original position of the i-th smallest key, so any
+ * payload stored alongside the keys can be gathered in order without moving
+ * it during the sort.
+ */
+#define PSORT_DECLARE(name, type)                                            \
+  void psort_##name(type *data, size_t count, int threads);                  \
+  type *psort_##name##_copy(type nums[], size_t count, int threads);         \
+  void psort_##name##_lowmem(type *data, size_t count, int threads);         \
+  void psort_##name##_argsort(type *keys, size_t count, size_t *perm, int threads);
+
+PSORT_DECLARE(long, long)
+PSORT_DECLARE(i32, int32_t)
+PSORT_DECLARE(u64, uint64_t)
+PSORT_DECLARE(f64, double)
+PSORT_DECLARE(kv, psort_kv_t)
+
+#endif
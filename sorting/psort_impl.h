@@ -0,0 +1,381 @@
+/**
+ * Parallel merge sort template.
+ *
+ * Include this file after defining:
+ *
+ *   PSORT_NAME   suffix of the generated functions
+ *   PSORT_TYPE   element type
+ *   PSORT_LESS   (optional) ordering expression, default (a) < (b)
+ *   PSORT_MERGE_KERNEL, PSORT_SMALL_KERNEL
+ *                (optional) functions replacing the generic merge of two
+ *                runs and the base-case sort, with the signatures of
+ *                merge_runs() and small_sort() in kernels.h
+ *   PSORT_TILE_KERNEL, PSORT_TILE_COUNT
+ *                (optional) a function with the signature of sort_run() in
+ *                kernels.h, and the largest slice it should get; each
+ *                thread's slices up to that size are sorted by it in one
+ *                go instead of recursing further
+ *
+ * It may be included several times per translation unit; the parameters
+ * are undefined again at the end.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "psort.h"
+#include "topology.h"
+#include "profile.h"
+
+#if !defined(PSORT_NAME) || !defined(PSORT_TYPE)
+#error "define PSORT_NAME and PSORT_TYPE before including psort_impl.h"
+#endif
+
+#ifndef PSORT_LESS
+#define PSORT_LESS(a, b) ((a) < (b))
+#endif
+
+#define PSORT_CAT2(a, b) a##_##b
+#define PSORT_CAT(a, b) PSORT_CAT2(a, b)
+#define PSORT_FN(fn) PSORT_CAT(fn, PSORT_NAME)
+
+typedef PSORT_TYPE PSORT_FN(psort_elem);
+
+// Helper struct to pass custom arguments to pthread_create
+typedef struct PSORT_FN(psort_task) {
+  PSORT_FN(psort_elem) *nums;
+  size_t from;
+  size_t to;
+  PSORT_FN(psort_elem) *target;
+  psort_budget_t *budget;
+} PSORT_FN(psort_task);
+
+
+#ifndef PSORT_MERGE_KERNEL
+/**
+ * Merge the sorted runs a and b into out, taking from a on ties. out may
+ * overlap b if b already sits at its end.
+ */
+static void PSORT_FN(psort_merge)(const PSORT_FN(psort_elem) *a, size_t na,
+                                  const PSORT_FN(psort_elem) *b, size_t nb,
+                                  PSORT_FN(psort_elem) *out) {
+  const PSORT_FN(psort_elem) *a_end = a + na;
+  const PSORT_FN(psort_elem) *b_end = b + nb;
+
+  while (a < a_end && b < b_end) {
+    int take_b = PSORT_LESS(*b, *a);
+    *out++ = take_b ? *b : *a;
+    a += !take_b;
+    b += take_b;
+  }
+  memcpy(out, a, (a_end - a) * sizeof(*a));
+  out += a_end - a;
+  memmove(out, b, (b_end - b) * sizeof(*b));
+}
+#define PSORT_MERGE PSORT_FN(psort_merge)
+#else
+#define PSORT_MERGE PSORT_MERGE_KERNEL
+#endif
+
+
+#ifndef PSORT_SMALL_KERNEL
+/**
+ * Insertion sort for the slices at the leaves of the recursion.
+ */
+static void PSORT_FN(psort_small)(PSORT_FN(psort_elem) *nums, size_t count) {
+  for (size_t i = 1; i < count; i++) {
+    PSORT_FN(psort_elem) x = nums[i];
+    size_t j = i;
+    while (j > 0 && PSORT_LESS(x, nums[j - 1])) {
+      nums[j] = nums[j - 1];
+      j--;
+    }
+    nums[j] = x;
+  }
+}
+#define PSORT_SMALL PSORT_FN(psort_small)
+#else
+#define PSORT_SMALL PSORT_SMALL_KERNEL
+#endif
+
+
+static void PSORT_FN(psort_aux)(PSORT_FN(psort_elem) *nums, size_t from, size_t to,
+                                PSORT_FN(psort_elem) *target, psort_budget_t *budget);
+
+#ifdef MSORT_PROFILE
+/**
+ * Recursion depth of the slice [from, to), for the profile.
+ */
+static int PSORT_FN(psort_level)(const psort_budget_t *budget, size_t from, size_t to) {
+  size_t lo = 0;
+  size_t hi = budget->count;
+  int level = 0;
+  while (hi - lo > to - from) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (from < mid) {
+      hi = mid;
+    }
+    else {
+      lo = mid;
+    }
+    level++;
+  }
+  return level;
+}
+#endif
+
+static void *PSORT_FN(psort_thread)(void *arg) {
+  PSORT_FN(psort_task) *task = arg;
+  topo_pin(psort_slot(task->budget, task->from));
+  PSORT_FN(psort_aux)(task->nums, task->from, task->to, task->target, task->budget);
+  return NULL;
+}
+
+/**
+ * Sort the given slice of nums into target.
+ *
+ * Both arrays hold the same data on entry. Warning: nums gets overwritten.
+ */
+static void PSORT_FN(psort_aux)(PSORT_FN(psort_elem) *nums, size_t from, size_t to,
+                                PSORT_FN(psort_elem) *target, psort_budget_t *budget) {
+  if (to - from <= PSORT_SMALL_MAX) {
+    PROF_BEGIN(small, "base case", PSORT_FN(psort_level)(budget, from, to));
+    PSORT_SMALL(&target[from], to - from);
+    PROF_END(small, 2 * (to - from) * sizeof(*nums));
+    return;
+  }
+
+#ifdef PSORT_TILE_KERNEL
+  // a cache-sized slice of one thread's share is sorted bottom-up, without
+  // recursing or asking for threads, while it stays in the cache
+  if (to - from <= (size_t) PSORT_TILE_COUNT &&
+      (to - from) * budget->threads <= budget->count) {
+    PROF_BEGIN(tile, "tile", PSORT_FN(psort_level)(budget, from, to));
+    PSORT_TILE_KERNEL(&target[from], &nums[from], to - from);
+    PROF_END(tile, 2 * (to - from) * sizeof(*nums));
+    return;
+  }
+#endif
+
+  size_t mid = from + (to - from) / 2;
+
+  // hand the right half to a new thread if the budget allows it
+  if (psort_claim_thread(budget)) {
+    PSORT_FN(psort_task) right = {target, mid, to, nums, budget};
+    pthread_t tid;
+    pthread_create(&tid, NULL, PSORT_FN(psort_thread), &right);
+    PSORT_FN(psort_aux)(target, from, mid, nums, budget);
+    pthread_join(tid, NULL);
+    psort_release_thread(budget);
+  }
+  else {
+    PSORT_FN(psort_aux)(target, from, mid, nums, budget);
+    PSORT_FN(psort_aux)(target, mid, to, nums, budget);
+  }
+
+  PROF_BEGIN(merge, "merge", PSORT_FN(psort_level)(budget, from, to));
+  PSORT_MERGE(&nums[from], mid - from, &nums[mid], to - mid, &target[from]);
+  PROF_END(merge, 2 * (to - from) * sizeof(*nums));
+}
+
+
+// Sort data in place.
+void PSORT_FN(psort)(PSORT_FN(psort_elem) *data, size_t count, int threads) {
+  PSORT_FN(psort_elem) *scratch = psort_alloc(count * sizeof(*data), threads);
+  assert(scratch != NULL);
+  memcpy(scratch, data, count * sizeof(*data));
+
+  psort_budget_t budget = PSORT_BUDGET(count, threads);
+  PSORT_FN(psort_aux)(scratch, 0, count, data, &budget);
+
+  free(scratch);
+}
+
+// Return a sorted copy of nums, overwriting nums.
+PSORT_FN(psort_elem) *PSORT_CAT(PSORT_FN(psort), copy)(PSORT_FN(psort_elem) nums[],
+                                                       size_t count, int threads) {
+  PSORT_FN(psort_elem) *result = psort_alloc(count * sizeof(*nums), threads);
+  assert(result != NULL);
+  memcpy(result, nums, count * sizeof(*nums));
+
+  psort_budget_t budget = PSORT_BUDGET(count, threads);
+  PSORT_FN(psort_aux)(nums, 0, count, result, &budget);
+
+  return result;
+}
+
+// Sort data in place with a scratch buffer of half its size.
+void PSORT_CAT(PSORT_FN(psort), lowmem)(PSORT_FN(psort_elem) *data, size_t count,
+                                        int threads) {
+  if (count <= PSORT_SMALL_MAX) {
+    PSORT_SMALL(data, count);
+    return;
+  }
+
+  // the right half is never smaller, so the buffer fits either half
+  size_t mid = count / 2;
+  size_t right = count - mid;
+  PSORT_FN(psort_elem) *scratch = psort_alloc(right * sizeof(*data), threads);
+  assert(scratch != NULL);
+  psort_budget_t budget = PSORT_BUDGET(right, threads);
+
+  // sort the right half in place, then the left half into the buffer
+  memcpy(scratch, &data[mid], right * sizeof(*data));
+  PSORT_FN(psort_aux)(scratch, 0, right, &data[mid], &budget);
+  budget.count = mid;
+  memcpy(scratch, data, mid * sizeof(*data));
+  PSORT_FN(psort_aux)(data, 0, mid, scratch, &budget);
+
+  // the output never catches up with the unmerged part of the right half
+  PROF_BEGIN(merge, "in-place merge", 0);
+  PSORT_MERGE(scratch, mid, &data[mid], right, data);
+  PROF_END(merge, 2 * count * sizeof(*data));
+
+  free(scratch);
+}
+
+
+/*
+ * Argsort: the keys are sorted together with a parallel array of their
+ * original positions (structure of arrays), so comparisons only touch the
+ * densely packed keys and payloads never move.
+ */
+
+// Helper struct to pass custom arguments to pthread_create
+typedef struct PSORT_FN(psort_argtask) {
+  PSORT_FN(psort_elem) *keys;
+  size_t *idx;
+  size_t from;
+  size_t to;
+  PSORT_FN(psort_elem) *target_keys;
+  size_t *target_idx;
+  psort_budget_t *budget;
+} PSORT_FN(psort_argtask);
+
+/**
+ * Merge the sorted key runs a and b into out, carrying their indices along
+ * and taking from a on ties.
+ */
+static void PSORT_FN(psort_argmerge)(const PSORT_FN(psort_elem) *a, const size_t *a_idx, size_t na,
+                                     const PSORT_FN(psort_elem) *b, const size_t *b_idx, size_t nb,
+                                     PSORT_FN(psort_elem) *out, size_t *out_idx) {
+  size_t i = 0;
+  size_t j = 0;
+  while (i < na && j < nb) {
+    int take_b = PSORT_LESS(b[j], a[i]);
+    *out++ = take_b ? b[j] : a[i];
+    *out_idx++ = take_b ? b_idx[j] : a_idx[i];
+    i += !take_b;
+    j += take_b;
+  }
+  memcpy(out, &a[i], (na - i) * sizeof(*a));
+  memcpy(out_idx, &a_idx[i], (na - i) * sizeof(size_t));
+  out += na - i;
+  out_idx += na - i;
+  memcpy(out, &b[j], (nb - j) * sizeof(*b));
+  memcpy(out_idx, &b_idx[j], (nb - j) * sizeof(size_t));
+}
+
+/**
+ * Insertion sort of keys and their indices.
+ */
+static void PSORT_FN(psort_argsmall)(PSORT_FN(psort_elem) *keys, size_t *idx, size_t count) {
+  for (size_t i = 1; i < count; i++) {
+    PSORT_FN(psort_elem) x = keys[i];
+    size_t xi = idx[i];
+    size_t j = i;
+    while (j > 0 && PSORT_LESS(x, keys[j - 1])) {
+      keys[j] = keys[j - 1];
+      idx[j] = idx[j - 1];
+      j--;
+    }
+    keys[j] = x;
+    idx[j] = xi;
+  }
+}
+
+static void PSORT_FN(psort_argaux)(PSORT_FN(psort_elem) *keys, size_t *idx,
+                                   size_t from, size_t to,
+                                   PSORT_FN(psort_elem) *target_keys, size_t *target_idx,
+                                   psort_budget_t *budget);
+
+static void *PSORT_FN(psort_argthread)(void *arg) {
+  PSORT_FN(psort_argtask) *task = arg;
+  topo_pin(psort_slot(task->budget, task->from));
+  PSORT_FN(psort_argaux)(task->keys, task->idx, task->from, task->to,
+                         task->target_keys, task->target_idx, task->budget);
+  return NULL;
+}
+
+/**
+ * Sort the given slice of keys and idx into the targets.
+ *
+ * Both pairs of arrays hold the same data on entry. Warning: keys and idx
+ * get overwritten.
+ */
+static void PSORT_FN(psort_argaux)(PSORT_FN(psort_elem) *keys, size_t *idx,
+                                   size_t from, size_t to,
+                                   PSORT_FN(psort_elem) *target_keys, size_t *target_idx,
+                                   psort_budget_t *budget) {
+  if (to - from <= PSORT_SMALL_MAX) {
+    PROF_BEGIN(small, "argsort base case", PSORT_FN(psort_level)(budget, from, to));
+    PSORT_FN(psort_argsmall)(&target_keys[from], &target_idx[from], to - from);
+    PROF_END(small, 2 * (to - from) * (sizeof(*keys) + sizeof(size_t)));
+    return;
+  }
+
+  size_t mid = from + (to - from) / 2;
+
+  if (psort_claim_thread(budget)) {
+    PSORT_FN(psort_argtask) right = {target_keys, target_idx, mid, to, keys, idx, budget};
+    pthread_t tid;
+    pthread_create(&tid, NULL, PSORT_FN(psort_argthread), &right);
+    PSORT_FN(psort_argaux)(target_keys, target_idx, from, mid, keys, idx, budget);
+    pthread_join(tid, NULL);
+    psort_release_thread(budget);
+  }
+  else {
+    PSORT_FN(psort_argaux)(target_keys, target_idx, from, mid, keys, idx, budget);
+    PSORT_FN(psort_argaux)(target_keys, target_idx, mid, to, keys, idx, budget);
+  }
+
+  PROF_BEGIN(merge, "argsort merge", PSORT_FN(psort_level)(budget, from, to));
+  PSORT_FN(psort_argmerge)(&keys[from], &idx[from], mid - from,
+                           &keys[mid], &idx[mid], to - mid,
+                           &target_keys[from], &target_idx[from]);
+  PROF_END(merge, 2 * (to - from) * (sizeof(*keys) + sizeof(size_t)));
+}
+
+// Sort keys in place and record where each element came from.
+void PSORT_CAT(PSORT_FN(psort), argsort)(PSORT_FN(psort_elem) *keys, size_t count,
+                                         size_t *perm, int threads) {
+  PSORT_FN(psort_elem) *scratch = psort_alloc(count * sizeof(*keys), threads);
+  size_t *scratch_idx = psort_alloc(count * sizeof(size_t), threads);
+  assert(scratch != NULL && scratch_idx != NULL);
+  memcpy(scratch, keys, count * sizeof(*keys));
+  for (size_t i = 0; i < count; i++) {
+    perm[i] = i;
+    scratch_idx[i] = i;
+  }
+
+  psort_budget_t budget = PSORT_BUDGET(count, threads);
+  PSORT_FN(psort_argaux)(scratch, scratch_idx, 0, count, keys, perm, &budget);
+
+  free(scratch);
+  free(scratch_idx);
+}
+
+
+#undef PSORT_MERGE
+#undef PSORT_SMALL
+#undef PSORT_FN
+#undef PSORT_CAT
+#undef PSORT_CAT2
+#undef PSORT_NAME
+#undef PSORT_TYPE
+#undef PSORT_LESS
+#undef PSORT_MERGE_KERNEL
+#undef PSORT_SMALL_KERNEL
+#undef PSORT_TILE_KERNEL
+#undef PSORT_TILE_COUNT
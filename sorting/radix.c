@@ -0,0 +1,248 @@
+/**
+ * Parallel LSD radix sort for 64-bit keys.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "psort.h"
+#include "radix.h"
+#include "topology.h"
+#include "profile.h"
+
+/** Number of longs in a write-combining buffer (one 64-byte cache line). */
+#define WC_LINE 8
+
+/** Flipping the sign bit makes signed keys order like unsigned ones. */
+#define SIGN_BIT (1UL << 63)
+
+#define digit_of(x, shift, mask) \
+  ((((unsigned long)(x) ^ SIGN_BIT) >> (shift)) & (mask))
+
+// State shared by all the workers of one sort
+typedef struct radix_shared {
+  long *src;
+  long *dst;
+  long count;
+  int threads;
+  int bits;
+  int passes;
+  long *hist;      // threads x passes x radix digit counts
+  int *trivial;    // passes flags, set when a pass would not move anything
+  pthread_barrier_t barrier;
+} radix_shared;
+
+// Helper struct to pass custom arguments to pthread_create
+typedef struct radix_args {
+  radix_shared *shared;
+  int id;
+} radix_args;
+
+
+/**
+ * Count the digits of nums[from..to) for the given pass into counts.
+ */
+static void count_digits(const long *nums, long from, long to, int shift,
+                         unsigned long mask, long *counts) {
+  for (long i = from; i < to; i++) {
+    counts[digit_of(nums[i], shift, mask)]++;
+  }
+}
+
+
+/**
+ * Scatter src[from..to) into dst by digit, starting each digit at offsets.
+ *
+ * Elements are staged in a cache-line sized buffer per digit and written out
+ * a full line at a time, which keeps the number of open write streams small.
+ */
+static void scatter(const long *src, long from, long to, long *dst, int shift,
+                    unsigned long mask, long *offsets, long *wc, int *fill) {
+  long radix = mask + 1;
+  memset(fill, 0, radix * sizeof(int));
+
+  for (long i = from; i < to; i++) {
+    long x = src[i];
+    unsigned long d = digit_of(x, shift, mask);
+    long *line = &wc[d * WC_LINE];
+    line[fill[d]++] = x;
+    if (fill[d] == WC_LINE) {
+      memcpy(&dst[offsets[d]], line, WC_LINE * sizeof(long));
+      offsets[d] += WC_LINE;
+      fill[d] = 0;
+    }
+  }
+
+  // flush the partially filled lines
+  for (long d = 0; d < radix; d++) {
+    if (fill[d] > 0) {
+      memcpy(&dst[offsets[d]], &wc[d * WC_LINE], fill[d] * sizeof(long));
+      offsets[d] += fill[d];
+    }
+  }
+}
+
+
+/**
+ * Sort this worker's share of every pass.
+ */
+static void *radix_worker(void *arg_in) {
+  radix_args *arg = arg_in;
+  radix_shared *sh = arg->shared;
+  int id = arg->id;
+  topo_pin(id);
+
+  long radix = 1L << sh->bits;
+  unsigned long mask = radix - 1;
+  long from = sh->count * id / sh->threads;
+  long to = sh->count * (id + 1) / sh->threads;
+
+  long *my_hist = &sh->hist[(long) id * sh->passes * radix];
+  long *offsets = malloc(radix * sizeof(long));
+  long *wc = malloc(radix * WC_LINE * sizeof(long));
+  int *fill = malloc(radix * sizeof(int));
+  assert(offsets != NULL && wc != NULL && fill != NULL);
+
+  // count the digits of every pass in one read over the input
+  PROF_BEGIN(histogram, "radix histogram", 0);
+  for (long i = from; i < to; i++) {
+    unsigned long key = (unsigned long) sh->src[i] ^ SIGN_BIT;
+    for (int p = 0; p < sh->passes; p++) {
+      my_hist[p * radix + ((key >> (p * sh->bits)) & mask)]++;
+    }
+  }
+  PROF_END(histogram, (to - from) * sizeof(long));
+  pthread_barrier_wait(&sh->barrier);
+
+  // a pass is trivial if a single digit value accounts for every element
+  if (id == 0) {
+    for (int p = 0; p < sh->passes; p++) {
+      sh->trivial[p] = 0;
+      for (long d = 0; d < radix; d++) {
+        long total = 0;
+        for (int t = 0; t < sh->threads; t++) {
+          total += sh->hist[((long) t * sh->passes + p) * radix + d];
+        }
+        if (total == sh->count) {
+          sh->trivial[p] = 1;
+        }
+        if (total != 0) {
+          break;
+        }
+      }
+    }
+  }
+  pthread_barrier_wait(&sh->barrier);
+
+  long *src = sh->src;
+  long *dst = sh->dst;
+  int first = 1;
+  for (int p = 0; p < sh->passes; p++) {
+    if (sh->trivial[p]) {
+      continue;
+    }
+    int shift = p * sh->bits;
+    long *counts = &my_hist[p * radix];
+
+    // the first pass can reuse the counts taken over the original input
+    if (!first) {
+      PROF_BEGIN(count, "radix count", p);
+      memset(counts, 0, radix * sizeof(long));
+      count_digits(src, from, to, shift, mask, counts);
+      PROF_END(count, (to - from) * sizeof(long));
+      pthread_barrier_wait(&sh->barrier);
+    }
+    first = 0;
+
+    // this thread's slot for digit d follows all smaller digits and the
+    // same digit of all lower-numbered threads
+    long base = 0;
+    for (long d = 0; d < radix; d++) {
+      long before = 0;
+      long total = 0;
+      for (int t = 0; t < sh->threads; t++) {
+        long c = sh->hist[((long) t * sh->passes + p) * radix + d];
+        if (t < id) {
+          before += c;
+        }
+        total += c;
+      }
+      offsets[d] = base + before;
+      base += total;
+    }
+
+    PROF_BEGIN(pass, "radix scatter", p);
+    scatter(src, from, to, dst, shift, mask, offsets, wc, fill);
+    PROF_END(pass, 2 * (to - from) * sizeof(long));
+    pthread_barrier_wait(&sh->barrier);
+
+    long *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+
+  free(offsets);
+  free(wc);
+  free(fill);
+  return NULL;
+}
+
+
+// Sort the given array with an LSD radix sort and return the sorted version.
+long *radix_sort(long nums[], long count, int threads, int bits) {
+  assert(bits == 8 || bits == 11);
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  long *result = psort_alloc(count * sizeof(long), threads);
+  assert(result != NULL);
+
+  radix_shared shared;
+  shared.src = nums;
+  shared.dst = result;
+  shared.count = count;
+  shared.threads = threads;
+  shared.bits = bits;
+  shared.passes = (64 + bits - 1) / bits;
+  shared.hist = calloc((long) threads * shared.passes << bits, sizeof(long));
+  shared.trivial = calloc(shared.passes, sizeof(int));
+  assert(shared.hist != NULL && shared.trivial != NULL);
+  pthread_barrier_init(&shared.barrier, NULL, threads);
+
+  radix_args *args = malloc(threads * sizeof(radix_args));
+  pthread_t *tids = malloc(threads * sizeof(pthread_t));
+  assert(args != NULL && tids != NULL);
+
+  // the calling thread works as worker 0
+  for (int t = 0; t < threads; t++) {
+    args[t].shared = &shared;
+    args[t].id = t;
+  }
+  for (int t = 1; t < threads; t++) {
+    pthread_create(&tids[t], NULL, radix_worker, &args[t]);
+  }
+  radix_worker(&args[0]);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+
+  // every non-trivial pass swaps the buffers, so after an even number of
+  // them the sorted data is back in nums
+  int moves = 0;
+  for (int p = 0; p < shared.passes; p++) {
+    moves += !shared.trivial[p];
+  }
+  if (moves % 2 == 0) {
+    memcpy(result, nums, count * sizeof(long));
+  }
+
+  pthread_barrier_destroy(&shared.barrier);
+  free(shared.hist);
+  free(shared.trivial);
+  free(args);
+  free(tids);
+
+  return result;
+}
@@ -0,0 +1,29 @@
+/**
+ * Parallel LSD radix sort for 64-bit keys.
+ */
+#ifndef RADIX_H
+#define RADIX_H
+
+/** Default digit width in bits. */
+#define RADIX_DEFAULT_BITS 11
+
+/**
+ * Sort the given array with an LSD radix sort and return the sorted version.
+ *
+ * Each pass builds per-thread digit histograms and scatters through
+ * cache-line sized write-combining buffers. Passes whose digit is the same
+ * for every element are skipped. Negative keys are handled by flipping the
+ * sign bit when extracting digits.
+ *
+ * The result is malloc'd so it is the caller's responsibility to free it.
+ *
+ * Warning: The source array gets overwritten.
+ *
+ * @param nums The array to sort.
+ * @param count Number of elements in the array.
+ * @param threads Number of worker threads to use.
+ * @param bits Digit width in bits (8 or 11).
+ */
+long *radix_sort(long nums[], long count, int threads, int bits);
+
+#endif
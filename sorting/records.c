@@ -0,0 +1,91 @@
+/**
+ * Key-payload record sorting and argsort for tmsort.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "tmsort.h"
+#include "records.h"
+#include "psort.h"
+
+
+/**
+ * Sort the keys, returning the permutation, and log how long it took.
+ */
+static size_t *timed_argsort(long *keys, long count, int threads) {
+  struct timeval begin, end;
+  size_t *perm = malloc(count * sizeof(size_t));
+  assert(count == 0 || perm != NULL);
+
+  gettimeofday(&begin, 0);
+  psort_long_argsort(keys, count, perm, threads);
+  gettimeofday(&end, 0);
+
+  log("Sorting completed in %f seconds.\n", time_in_secs(&begin, &end));
+  return perm;
+}
+
+
+// Read, sort and print count "key payload" records.
+int sort_records(long count, int threads) {
+  struct timeval begin, end;
+
+  gettimeofday(&begin, 0);
+  long *keys = malloc(count * sizeof(long));
+  long *payloads = malloc(count * sizeof(long));
+  assert(count == 0 || (keys != NULL && payloads != NULL));
+
+  tty_printf("Enter %ld records of a key and a payload\n", count);
+  long n = 0;
+  while (n < count && scanf("%ld %ld", &keys[n], &payloads[n]) == 2) {
+    n++;
+  }
+  gettimeofday(&end, 0);
+  log("Array read in %f seconds, beginning sort.\n", time_in_secs(&begin, &end));
+
+  size_t *perm = timed_argsort(keys, n, threads);
+
+  gettimeofday(&begin, 0);
+  for (long i = 0; i < n; i++) {
+    printf("%ld %ld\n", keys[i], payloads[perm[i]]);
+  }
+  gettimeofday(&end, 0);
+  log("Array printed in %f seconds.\n", time_in_secs(&begin, &end));
+
+  free(keys);
+  free(payloads);
+  free(perm);
+  return 0;
+}
+
+
+// Read count keys and print their stably sorted order as input positions.
+int argsort_keys(long count, int threads) {
+  struct timeval begin, end;
+
+  gettimeofday(&begin, 0);
+  long *keys = malloc(count * sizeof(long));
+  assert(count == 0 || keys != NULL);
+
+  tty_printf("Enter %ld elements, separated by whitespace\n", count);
+  long n = 0;
+  while (n < count && scanf("%ld", &keys[n]) == 1) {
+    n++;
+  }
+  gettimeofday(&end, 0);
+  log("Array read in %f seconds, beginning sort.\n", time_in_secs(&begin, &end));
+
+  size_t *perm = timed_argsort(keys, n, threads);
+
+  gettimeofday(&begin, 0);
+  for (long i = 0; i < n; i++) {
+    printf("%zu\n", perm[i]);
+  }
+  gettimeofday(&end, 0);
+  log("Array printed in %f seconds.\n", time_in_secs(&begin, &end));
+
+  free(keys);
+  free(perm);
+  return 0;
+}
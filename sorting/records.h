@@ -0,0 +1,27 @@
+/**
+ * Key-payload record sorting and argsort for tmsort.
+ */
+#ifndef RECORDS_H
+#define RECORDS_H
+
+/**
+ * Read up to count "key payload" records from stdin, sort them stably by
+ * key and print them in order, one record per line.
+ *
+ * Keys and payloads are kept in separate arrays: the sort only moves the
+ * keys and their original positions, and the payloads are gathered through
+ * that permutation while printing.
+ *
+ * @return 0 on success.
+ */
+int sort_records(long count, int threads);
+
+/**
+ * Read up to count keys from stdin and print, one per line, the zero-based
+ * input positions of the keys in stably sorted order.
+ *
+ * @return 0 on success.
+ */
+int argsort_keys(long count, int threads);
+
+#endif
@@ -0,0 +1,222 @@
+/**
+ * Parallel sample sort.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "psort.h"
+#include "samplesort.h"
+#include "kernels.h"
+#include "topology.h"
+#include "profile.h"
+
+// State shared by all the workers of one sort
+typedef struct ss_shared {
+  long *src;
+  long *dst;
+  long count;
+  int threads;
+  const long *splitters;  // unique, ascending
+  int nsplitters;
+  int nbuckets;           // 2 * nsplitters + 1
+  long *hist;             // threads x nbuckets element counts
+  long *bucket_start;     // nbuckets + 1 offsets into dst
+  int next_bucket;        // next bucket to hand out for sorting
+  pthread_mutex_t lock;
+  pthread_barrier_t barrier;
+} ss_shared;
+
+// Helper struct to pass custom arguments to pthread_create
+typedef struct ss_args {
+  ss_shared *shared;
+  int id;
+} ss_args;
+
+
+/**
+ * Find the bucket of x. Elements between two splitters go to an even bucket,
+ * elements equal to a splitter to the odd bucket after it.
+ */
+static inline int classify(const ss_shared *sh, long x) {
+  // branchless lower bound over the splitters
+  const long *base = sh->splitters;
+  int n = sh->nsplitters;
+  while (n > 1) {
+    int half = n / 2;
+    base = base[half - 1] < x ? base + half : base;
+    n -= half;
+  }
+  int i = (base - sh->splitters) + (n == 1 && *base < x);
+  int equal = i < sh->nsplitters && sh->splitters[i] == x;
+  return 2 * i + equal;
+}
+
+
+/**
+ * Partition this worker's share of the input, then sort buckets until none
+ * are left.
+ */
+static void *ss_worker(void *arg_in) {
+  ss_args *arg = arg_in;
+  ss_shared *sh = arg->shared;
+  int id = arg->id;
+  topo_pin(id);
+  int nb = sh->nbuckets;
+
+  long from = sh->count * id / sh->threads;
+  long to = sh->count * (id + 1) / sh->threads;
+  long *counts = &sh->hist[(long) id * nb];
+
+  PROF_BEGIN(counting, "sample classify", 0);
+  for (long i = from; i < to; i++) {
+    counts[classify(sh, sh->src[i])]++;
+  }
+  PROF_END(counting, (to - from) * sizeof(long));
+  pthread_barrier_wait(&sh->barrier);
+
+  // bucket sizes and starts, computed once for everybody
+  if (id == 0) {
+    long start = 0;
+    for (int b = 0; b < nb; b++) {
+      sh->bucket_start[b] = start;
+      for (int t = 0; t < sh->threads; t++) {
+        start += sh->hist[(long) t * nb + b];
+      }
+    }
+    sh->bucket_start[nb] = start;
+  }
+  pthread_barrier_wait(&sh->barrier);
+
+  // this thread writes after the same bucket of lower-numbered threads
+  long *offsets = malloc(nb * sizeof(long));
+  assert(offsets != NULL);
+  for (int b = 0; b < nb; b++) {
+    offsets[b] = sh->bucket_start[b];
+    for (int t = 0; t < id; t++) {
+      offsets[b] += sh->hist[(long) t * nb + b];
+    }
+  }
+  PROF_BEGIN(distribute, "sample distribute", 0);
+  for (long i = from; i < to; i++) {
+    long x = sh->src[i];
+    sh->dst[offsets[classify(sh, x)]++] = x;
+  }
+  PROF_END(distribute, 2 * (to - from) * sizeof(long));
+  free(offsets);
+  pthread_barrier_wait(&sh->barrier);
+
+  // the source array is free now and serves as scratch for the bucket sorts
+  for (;;) {
+    pthread_mutex_lock(&sh->lock);
+    int b = sh->next_bucket;
+    sh->next_bucket += 2;
+    pthread_mutex_unlock(&sh->lock);
+    if (b >= nb) {
+      break;
+    }
+    long start = sh->bucket_start[b];
+    long len = sh->bucket_start[b + 1] - start;
+    PROF_BEGIN(bucket, "sample bucket sort", 1);
+    sort_run(&sh->dst[start], &sh->src[start], len);
+    PROF_END(bucket, 2 * len * sizeof(long));
+  }
+
+  return NULL;
+}
+
+
+/**
+ * Draw a sorted sample and pick the unique splitters from it.
+ *
+ * Returns the number of splitters written to splitters.
+ */
+static int pick_splitters(const long *nums, long count, int buckets, long *splitters) {
+  int samples = buckets * SAMPLESORT_OVERSAMPLE;
+  if (samples > count) {
+    samples = count;
+  }
+  long *sample = malloc(samples * sizeof(long));
+  long *tmp = malloc(samples * sizeof(long));
+  assert(sample != NULL && tmp != NULL);
+
+  // xorshift keeps the sample reproducible from run to run
+  unsigned long state = 88172645463325252UL;
+  for (int i = 0; i < samples; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    sample[i] = nums[state % count];
+  }
+  sort_run(sample, tmp, samples);
+
+  int n = 0;
+  for (int b = 1; b < buckets; b++) {
+    long s = sample[(long) b * samples / buckets];
+    if (n == 0 || splitters[n - 1] != s) {
+      splitters[n++] = s;
+    }
+  }
+
+  free(sample);
+  free(tmp);
+  return n;
+}
+
+
+// Sort the given array with a sample sort and return the sorted version.
+long *sample_sort(long nums[], long count, int threads) {
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  long *result = psort_alloc(count * sizeof(long), threads);
+  assert(result != NULL);
+
+  int buckets = threads == 1 ? 1 : threads * SAMPLESORT_BUCKETS_PER_THREAD;
+  long *splitters = malloc(buckets * sizeof(long));
+  assert(splitters != NULL);
+
+  ss_shared shared;
+  shared.src = nums;
+  shared.dst = result;
+  shared.count = count;
+  shared.threads = threads;
+  shared.splitters = splitters;
+  shared.nsplitters = count > 0 ? pick_splitters(nums, count, buckets, splitters) : 0;
+  shared.nbuckets = 2 * shared.nsplitters + 1;
+  shared.hist = calloc((long) threads * shared.nbuckets, sizeof(long));
+  shared.bucket_start = malloc((shared.nbuckets + 1) * sizeof(long));
+  shared.next_bucket = 0;
+  assert(shared.hist != NULL && shared.bucket_start != NULL);
+  pthread_mutex_init(&shared.lock, NULL);
+  pthread_barrier_init(&shared.barrier, NULL, threads);
+
+  ss_args *args = malloc(threads * sizeof(ss_args));
+  pthread_t *tids = malloc(threads * sizeof(pthread_t));
+  assert(args != NULL && tids != NULL);
+
+  // the calling thread works as worker 0
+  for (int t = 0; t < threads; t++) {
+    args[t].shared = &shared;
+    args[t].id = t;
+  }
+  for (int t = 1; t < threads; t++) {
+    pthread_create(&tids[t], NULL, ss_worker, &args[t]);
+  }
+  ss_worker(&args[0]);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+
+  pthread_mutex_destroy(&shared.lock);
+  pthread_barrier_destroy(&shared.barrier);
+  free(shared.hist);
+  free(shared.bucket_start);
+  free(splitters);
+  free(args);
+  free(tids);
+
+  return result;
+}
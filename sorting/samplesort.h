@@ -0,0 +1,28 @@
+/**
+ * Parallel sample sort.
+ */
+#ifndef SAMPLESORT_H
+#define SAMPLESORT_H
+
+/** Sample elements drawn per bucket when picking splitters. */
+#define SAMPLESORT_OVERSAMPLE 32
+
+/** Buckets per thread, so faster threads can pick up extra buckets. */
+#define SAMPLESORT_BUCKETS_PER_THREAD 4
+
+/**
+ * Sort the given array with a sample sort and return the sorted version.
+ *
+ * Splitters are picked from a sorted random sample, every thread
+ * classifies and scatters its share of the input into buckets, and the
+ * buckets are then sorted independently. Every splitter also gets an
+ * equality bucket for the elements equal to it. Those buckets need no
+ * sorting, so inputs with many duplicates still split evenly.
+ *
+ * The result is malloc'd so it is the caller's responsibility to free it.
+ *
+ * Warning: The source array gets overwritten.
+ */
+long *sample_sort(long nums[], long count, int threads);
+
+#endif
@@ -0,0 +1,169 @@
+/**
+ * Input, output and timing helpers shared by the msort and tmsort front-ends.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/resource.h>
+
+#include "sortio.h"
+#include "psort.h"
+
+// Compute the delta between the given timevals in seconds.
+double time_in_secs(const struct timeval *begin, const struct timeval *end) {
+  long s = end->tv_sec - begin->tv_sec;
+  long ms = end->tv_usec - begin->tv_usec;
+  return s + ms * 1e-6;
+}
+
+// Peak resident set size of the process so far, in megabytes.
+long peak_rss_mb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024;
+}
+
+/** Size of the long reader's buffer. */
+#define READER_BUFFER (1 << 20)
+
+// Start reading longs from in.
+void long_reader_init(long_reader_t *reader, FILE *in) {
+  reader->in = in;
+  reader->buf = malloc(READER_BUFFER);
+  assert(reader->buf != NULL);
+  reader->pos = 0;
+  reader->len = 0;
+  reader->eof = 0;
+}
+
+/**
+ * Make sure at least want bytes are buffered unless the input ends first.
+ */
+static void long_reader_fill(long_reader_t *reader, size_t want) {
+  if (reader->len - reader->pos >= want || reader->eof) {
+    return;
+  }
+  memmove(reader->buf, &reader->buf[reader->pos], reader->len - reader->pos);
+  reader->len -= reader->pos;
+  reader->pos = 0;
+  while (reader->len < want && !reader->eof) {
+    size_t n = fread(&reader->buf[reader->len], 1, READER_BUFFER - reader->len, reader->in);
+    reader->len += n;
+    reader->eof = n == 0;
+  }
+}
+
+// Read the next long.
+int long_reader_next(long_reader_t *reader, long *out) {
+  // skip whitespace, then make sure the whole number is buffered
+  for (;;) {
+    long_reader_fill(reader, 1);
+    if (reader->pos == reader->len) {
+      return 0;
+    }
+    char c = reader->buf[reader->pos];
+    if (c != ' ' && c != '\n' && c != '\t' && c != '\r' && c != '\v' && c != '\f') {
+      break;
+    }
+    reader->pos++;
+  }
+  long_reader_fill(reader, FORMATTED_LONG_MAX + 1);
+
+  const char *p = &reader->buf[reader->pos];
+  const char *end = &reader->buf[reader->len];
+  int negative = *p == '-';
+  if (*p == '-' || *p == '+') {
+    p++;
+  }
+  if (p == end || *p < '0' || *p > '9') {
+    return 0;
+  }
+  unsigned long value = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    value = value * 10 + (*p++ - '0');
+  }
+  reader->pos = p - reader->buf;
+  *out = negative ? -value : value;
+  return 1;
+}
+
+// Free the reader's buffer.
+void long_reader_free(long_reader_t *reader) {
+  free(reader->buf);
+  reader->buf = NULL;
+}
+
+/**
+ * Write x in decimal, right-aligned in at least width characters. Returns
+ * the end of the text.
+ */
+static char *format_long(long x, int width, char *out) {
+  unsigned long u = x < 0 ? -(unsigned long) x : (unsigned long) x;
+
+  // digits come out least significant first
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + u % 10;
+    u /= 10;
+  } while (u > 0);
+  for (int pad = width - n - (x < 0); pad > 0; pad--) {
+    *out++ = ' ';
+  }
+  if (x < 0) {
+    *out++ = '-';
+  }
+  while (n > 0) {
+    *out++ = digits[--n];
+  }
+  return out;
+}
+
+// Format count longs into buf, an element per line.
+size_t format_long_array(const long *array, long count, char *buf) {
+  char *out = buf;
+  for (long i = 0; i < count; i++) {
+    out = format_long(array[i], 0, out);
+    *out++ = '\n';
+  }
+  return out - buf;
+}
+
+// Format count longs into buf with their counts in front, like uniq -c.
+size_t format_counted_array(const long *array, const long *counts, long count,
+                            char *buf) {
+  char *out = buf;
+  for (long i = 0; i < count; i++) {
+    out = format_long(counts[i], 7, out);
+    *out++ = ' ';
+    out = format_long(array[i], 0, out);
+    *out++ = '\n';
+  }
+  return out - buf;
+}
+
+// Print the given array of longs, an element per line.
+void print_long_array(const long *array, long count) {
+  for (long i = 0; i < count; ++i) {
+    printf("%ld\n", array[i]);
+  }
+}
+
+// Allocate and populate the input array from stdin.
+long allocate_load_array(int argc, char **argv, long **array, int threads) {
+  assert(argc > 1);
+  long count = atol(argv[1]);
+
+  *array = psort_alloc(count * sizeof(long), threads);
+  assert(*array != NULL);
+
+  long element;
+  tty_printf("Enter %ld elements, separated by whitespace\n", count);
+  long i = 0;
+  while (i < count && scanf("%ld", &element) != EOF)  {
+    (*array)[i++] = element;
+  }
+
+  return count;
+}
@@ -0,0 +1,96 @@
+/**
+ * Input, output and timing helpers shared by the msort and tmsort front-ends.
+ */
+#ifndef SORTIO_H
+#define SORTIO_H
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define tty_printf(...) (isatty(1) && isatty(0) ? printf(__VA_ARGS__) : 0)
+
+#ifndef SHUSH
+#define log(...) (fprintf(stderr, __VA_ARGS__))
+#else 
+#define log(...)
+#endif
+
+/** Longest line format_long_array() writes for one element. */
+#define FORMATTED_LONG_MAX 21
+
+/** Longest line format_counted_array() writes for one element. */
+#define FORMATTED_COUNTED_MAX (FORMATTED_LONG_MAX + 20)
+
+/**
+ * A buffered reader of whitespace-separated decimal longs that parses them
+ * itself instead of going through scanf().
+ */
+typedef struct long_reader {
+  FILE *in;
+  char *buf;
+  size_t pos;
+  size_t len;
+  int eof;
+} long_reader_t;
+
+/**
+ * Start reading longs from in.
+ */
+void long_reader_init(long_reader_t *reader, FILE *in);
+
+/**
+ * Read the next long into out. Returns 1 on success, 0 at the end of the
+ * input or at the first token that is not a number.
+ */
+int long_reader_next(long_reader_t *reader, long *out);
+
+/**
+ * Free the reader's buffer. The stream stays open.
+ */
+void long_reader_free(long_reader_t *reader);
+
+/**
+ * Format count longs into buf, an element per line, like print_long_array()
+ * would print them. buf needs FORMATTED_LONG_MAX bytes per element.
+ *
+ * Returns the number of bytes written.
+ */
+size_t format_long_array(const long *array, long count, char *buf);
+
+/**
+ * Format count longs into buf with their counts in front, in the format of
+ * uniq -c. buf needs FORMATTED_COUNTED_MAX bytes per element.
+ *
+ * Returns the number of bytes written.
+ */
+size_t format_counted_array(const long *array, const long *counts, long count,
+                            char *buf);
+
+/**
+ * Compute the delta between the given timevals in seconds.
+ */
+double time_in_secs(const struct timeval *begin, const struct timeval *end);
+
+/**
+ * Peak resident set size of the process so far, in megabytes.
+ */
+long peak_rss_mb(void);
+
+/**
+ * Print the given array of longs, an element per line.
+ */
+void print_long_array(const long *array, long count);
+
+/**
+ * Based on command line arguments, allocate and populate an input and a 
+ * helper array.
+ *
+ * The array comes from psort_alloc(), so large inputs are backed by huge
+ * pages that threads threads touch first.
+ *
+ * Returns the number of elements in the array.
+ */
+long allocate_load_array(int argc, char **argv, long **array, int threads);
+
+#endif
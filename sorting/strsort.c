@@ -0,0 +1,176 @@
+/**
+ * Parallel multikey quicksort for lines of text.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "psort.h"
+#include "strsort.h"
+#include "topology.h"
+
+// Helper struct to pass custom arguments to pthread_create
+typedef struct str_task {
+  str_ref_t *refs;
+  size_t from;
+  size_t to;
+  size_t depth;
+  psort_budget_t *budget;
+} str_task;
+
+
+/**
+ * The 8 bytes of s starting at depth as a big-endian word, zero padded.
+ */
+static inline uint64_t word_at(const char *s, size_t len, size_t depth) {
+  uint64_t w = 0;
+  if (depth + 8 <= len) {
+    memcpy(&w, s + depth, 8);
+    return __builtin_bswap64(w);
+  }
+  for (size_t i = depth; i < depth + 8; i++) {
+    w = w << 8 | (i < len ? (unsigned char) s[i] : 0);
+  }
+  return w;
+}
+
+
+/**
+ * Compare two lines whose first depth bytes are known to be equal.
+ */
+static inline int compare_from(const str_ref_t *a, const str_ref_t *b, size_t depth) {
+  if (a->prefix != b->prefix) {
+    return a->prefix < b->prefix ? -1 : 1;
+  }
+  size_t n = a->len < b->len ? a->len : b->len;
+  if (n > depth) {
+    int c = memcmp(a->str + depth, b->str + depth, n - depth);
+    if (c != 0) {
+      return c;
+    }
+  }
+  return a->len < b->len ? -1 : a->len > b->len;
+}
+
+
+static void insertion_sort(str_ref_t *refs, size_t count, size_t depth) {
+  for (size_t i = 1; i < count; i++) {
+    str_ref_t x = refs[i];
+    size_t j = i;
+    while (j > 0 && compare_from(&x, &refs[j - 1], depth) < 0) {
+      refs[j] = refs[j - 1];
+      j--;
+    }
+    refs[j] = x;
+  }
+}
+
+
+static inline void swap_refs(str_ref_t *a, str_ref_t *b) {
+  str_ref_t t = *a;
+  *a = *b;
+  *b = t;
+}
+
+
+static uint64_t median_of_3(uint64_t a, uint64_t b, uint64_t c) {
+  if (a < b) {
+    return b < c ? b : (a < c ? c : a);
+  }
+  return a < c ? a : (b < c ? c : b);
+}
+
+
+static void mkqs(str_ref_t *refs, size_t from, size_t to, size_t depth,
+                 psort_budget_t *budget);
+
+static void *mkqs_thread(void *arg) {
+  str_task *task = arg;
+  topo_pin(psort_slot(task->budget, task->from));
+  mkqs(task->refs, task->from, task->to, task->depth, task->budget);
+  return NULL;
+}
+
+
+/**
+ * Sort refs[from..to), whose first depth + 8 bytes are all equal.
+ */
+static void sort_equal(str_ref_t *refs, size_t from, size_t to, size_t depth,
+                       psort_budget_t *budget) {
+  // lines that end within the word only differ in length, and come first
+  size_t rest = from;
+  for (size_t i = from; i < to; i++) {
+    if (refs[i].len <= depth + 8) {
+      swap_refs(&refs[rest++], &refs[i]);
+    }
+  }
+  insertion_sort(&refs[from], rest - from, depth);
+
+  if (to - rest > 1) {
+    for (size_t i = rest; i < to; i++) {
+      refs[i].prefix = word_at(refs[i].str, refs[i].len, depth + 8);
+    }
+    mkqs(refs, rest, to, depth + 8, budget);
+  }
+}
+
+
+/**
+ * Sort refs[from..to), whose first depth bytes are all equal and whose
+ * prefixes hold the 8 bytes at depth.
+ */
+static void mkqs(str_ref_t *refs, size_t from, size_t to, size_t depth,
+                 psort_budget_t *budget) {
+  if (to - from <= STRSORT_SMALL) {
+    insertion_sort(&refs[from], to - from, depth);
+    return;
+  }
+
+  str_ref_t *r = &refs[from];
+  size_t n = to - from;
+  uint64_t pivot = median_of_3(r[0].prefix, r[n / 2].prefix, r[n - 1].prefix);
+
+  // three-way partition: [0, lt) < pivot, [lt, gt) == pivot, [gt, n) >
+  size_t lt = 0;
+  size_t i = 0;
+  size_t gt = n;
+  while (i < gt) {
+    if (r[i].prefix < pivot) {
+      swap_refs(&r[lt++], &r[i++]);
+    }
+    else if (r[i].prefix > pivot) {
+      swap_refs(&r[i], &r[--gt]);
+    }
+    else {
+      i++;
+    }
+  }
+
+  // hand the lower part to a new thread if the budget allows it
+  str_task lower = {refs, from, from + lt, depth, budget};
+  pthread_t tid;
+  int spawned = lt >= STRSORT_PARALLEL_MIN && psort_claim_thread(budget);
+  if (spawned) {
+    pthread_create(&tid, NULL, mkqs_thread, &lower);
+  }
+  else {
+    mkqs(refs, from, from + lt, depth, budget);
+  }
+  mkqs(refs, from + gt, to, depth, budget);
+  sort_equal(refs, from + lt, from + gt, depth, budget);
+
+  if (spawned) {
+    pthread_join(tid, NULL);
+    psort_release_thread(budget);
+  }
+}
+
+
+// Sort the lines in byte order.
+void strsort(str_ref_t *refs, size_t count, int threads) {
+  for (size_t i = 0; i < count; i++) {
+    refs[i].prefix = word_at(refs[i].str, refs[i].len, 0);
+  }
+  psort_budget_t budget = PSORT_BUDGET(count, threads);
+  mkqs(refs, 0, count, 0, &budget);
+}
@@ -0,0 +1,41 @@
+/**
+ * Parallel multikey quicksort for lines of text.
+ */
+#ifndef STRSORT_H
+#define STRSORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Partitions smaller than this are insertion sorted. */
+#define STRSORT_SMALL 16
+
+/** Partitions smaller than this are never handed to another thread. */
+#define STRSORT_PARALLEL_MIN (1L << 14)
+
+/**
+ * A line to sort: where it is, and the 8 bytes at the current depth of the
+ * sort, cached so that most comparisons do not touch the text.
+ */
+typedef struct str_ref {
+  uint64_t prefix;
+  const char *str;
+  size_t len;
+} str_ref_t;
+
+/**
+ * Sort the lines in byte order (like LC_ALL=C sort), a line that is a
+ * prefix of another coming first.
+ *
+ * The sort is a multikey quicksort whose "characters" are 8-byte big-endian
+ * words: each partition step compares cached words only, and lines whose
+ * words are equal move on together to the next 8 bytes. Large partitions are
+ * sorted by new threads while the thread budget allows.
+ *
+ * @param refs The lines; only str and len need to be set.
+ * @param count Number of lines.
+ * @param threads Number of threads to use.
+ */
+void strsort(str_ref_t *refs, size_t count, int threads);
+
+#endif
@@ -1,252 +1,335 @@
+/**
+ * Threaded sort front-end: reads the input, runs the selected engine and
+ * prints the result.
+ */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <assert.h>
 #include <sys/time.h>
 #include <unistd.h>
-#include <assert.h>
-#include <pthread.h>
-
-#define tty_printf(...) (isatty(1) && isatty(0) ? printf(__VA_ARGS__) : 0)
-
-#ifndef SHUSH
-#define log(...) (fprintf(stderr, __VA_ARGS__))
-#else 
-#define log(...)
-#endif
+#include <getopt.h>
+
+#include "tmsort.h"
+#include "psort.h"
+#include "kernels.h"
+#include "radix.h"
+#include "extsort.h"
+#include "multiway.h"
+#include "samplesort.h"
+#include "records.h"
+#include "adaptive.h"
+#include "topk.h"
+#include "pipeline.h"
+#include "aggregate.h"
+#include "filemerge.h"
+#include "autoselect.h"
+#include "topology.h"
+#include "profile.h"
 
 
 /** The number of threads to be used for sorting. Default: 1 */
 int max_thread_count = 1;
 
-/** Keep track of number of threads running to ensure it does not surpass maximum number of threads to run */
-int current_thread_count = 1;
-
-// Helper struct to pass custom arguments to pthread_create
-typedef struct args {
-  long *nums;
-  int from;
-  int to; 
-  long *target;
-} args;
+/** Command line names of the engines, indexed by engine_t */
+const char *engine_names[] = {"merge", "radix", "multiway", "sample", "adaptive", "auto"};
 
+/** Long spellings of the options that have them */
+const struct option long_options[] = {
+  {"unique", no_argument, NULL, 'u'},
+  {"count", no_argument, NULL, 'c'},
+  {NULL, 0, NULL, 0},
+};
 
 /**
- * Compute the delta between the given timevals in seconds.
+ * Look up the engine with the given name.
+ *
+ * Returns -1 if there is no such engine.
  */
-double time_in_secs(const struct timeval *begin, const struct timeval *end) {
-  long s = end->tv_sec - begin->tv_sec;
-  long ms = end->tv_usec - begin->tv_usec;
-  return s + ms * 1e-6;
+int parse_engine(const char *name) {
+  for (int e = 0; e < sizeof(engine_names) / sizeof(engine_names[0]); e++) {
+    if (strcmp(name, engine_names[e]) == 0) {
+      return e;
+    }
+  }
+  return -1;
 }
 
 
-/**
- * Print the given array of longs, an element per line.
- */
-void print_long_array(const long *array, int count) {
-  for (int i = 0; i < count; ++i) {
-    printf("%ld\n", array[i]);
-  }
+void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [options] <n>\n", prog);
+  fprintf(stderr, "       %s -m [-B] <file>...\n", prog);
+  fprintf(stderr, "  -e ENGINE  merge (default), radix, multiway, sample, adaptive or auto\n");
+  fprintf(stderr, "  -b BITS    radix digit width, 8 or 11 (default %d)\n", RADIX_DEFAULT_BITS);
+  fprintf(stderr, "  -x         external sort through temporary run files\n");
+  fprintf(stderr, "  -M MB      external sort memory budget in megabytes (default %d)\n",
+          EXTSORT_DEFAULT_BUDGET_MB);
+  fprintf(stderr, "  -T DIR     directory for the run files (default $TMPDIR or /tmp)\n");
+  fprintf(stderr, "  -r         sort \"key payload\" records stably by key\n");
+  fprintf(stderr, "  -a         print the input positions of the sorted keys (argsort)\n");
+  fprintf(stderr, "  -p         pipelined: sort chunks while reading, print while merging\n");
+  fprintf(stderr, "  -l         low-memory merge sort with a half-size buffer\n");
+  fprintf(stderr, "  -k K       print only the K smallest keys\n");
+  fprintf(stderr, "  -K K       print only the K largest keys\n");
+  fprintf(stderr, "  -m         merge the given sorted files instead of sorting stdin\n");
+  fprintf(stderr, "  -B         the files to merge hold binary longs, merged in parallel\n");
+  fprintf(stderr, "  -u, --unique  print every distinct key once\n");
+  fprintf(stderr, "  -c, --count   print distinct keys with their counts, like uniq -c\n");
 }
 
 
-/**
- * Merge two slices of nums into the corresponding portion of target.
- */
-void merge(long nums[], int from, int mid, int to, long target[]) {
-  int left = from;
-  int right = mid;
-
-  int i = from;
-  for (; i < to && left < mid && right < to; i++) {
-    if (nums[left] <= nums[right]) {
-      target[i] = nums[left];
-      left++;
-    }
-    else {
-      target[i] = nums[right];
-      right++;
+int main(int argc, char **argv) {
+  engine_t engine = ENGINE_MERGE;
+  int radix_bits = RADIX_DEFAULT_BITS;
+  int external = 0;
+  int records = 0;
+  int argsort = 0;
+  int lowmem = 0;
+  int pipelined = 0;
+  long top = -1;
+  int largest = 0;
+  aggregate_t aggregate = AGGREGATE_NONE;
+  int merge = 0;
+  int binary = 0;
+  double budget_mb = EXTSORT_DEFAULT_BUDGET_MB;
+  const char *tmp_dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "e:b:xM:T:ralpk:K:ucmB", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'e':
+      if (parse_engine(optarg) == -1) {
+        fprintf(stderr, "Unknown engine: %s\n", optarg);
+        usage(argv[0]);
+        return 1;
+      }
+      engine = parse_engine(optarg);
+      break;
+    case 'b':
+      radix_bits = atoi(optarg);
+      if (radix_bits != 8 && radix_bits != 11) {
+        fprintf(stderr, "Radix digits must be 8 or 11 bits wide\n");
+        return 1;
+      }
+      break;
+    case 'x':
+      external = 1;
+      break;
+    case 'M':
+      budget_mb = atof(optarg);
+      if (budget_mb <= 0) {
+        fprintf(stderr, "Memory budget must be positive\n");
+        return 1;
+      }
+      break;
+    case 'T':
+      tmp_dir = optarg;
+      break;
+    case 'r':
+      records = 1;
+      break;
+    case 'a':
+      argsort = 1;
+      break;
+    case 'l':
+      lowmem = 1;
+      break;
+    case 'p':
+      pipelined = 1;
+      break;
+    case 'k':
+    case 'K':
+      top = atol(optarg);
+      largest = opt == 'K';
+      if (top < 0) {
+        fprintf(stderr, "K must not be negative\n");
+        return 1;
+      }
+      break;
+    case 'u':
+      if (aggregate == AGGREGATE_NONE) {
+        aggregate = AGGREGATE_UNIQUE;
+      }
+      break;
+    case 'c':
+      aggregate = AGGREGATE_COUNT;
+      break;
+    case 'm':
+      merge = 1;
+      break;
+    case 'B':
+      binary = 1;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
     }
   }
-  if (left < mid) {
-    memmove(&target[i], &nums[left], (mid - left) * sizeof(long));
+
+  if (lowmem && engine != ENGINE_MERGE) {
+    fprintf(stderr, "Low-memory mode only works with the merge engine\n");
+    return 1;
   }
-  else if (right < to) {
-    memmove(&target[i], &nums[right], (to - right) * sizeof(long));
+  if (aggregate != AGGREGATE_NONE && (external || records || argsort || top >= 0)) {
+    fprintf(stderr, "Unique and count modes do not work with -x, -r, -a, -k or -K\n");
+    return 1;
   }
-}
-
 
-/**
- * Sort the given slice of nums into target.
- *
- * Warning: nums gets overwritten.
- */
-void* merge_sort_aux(void *arg_in) {
-  struct args *arg = arg_in;
-  long *nums = arg->nums; 
-  int from = arg->from;
-  int to = arg->to;
-  long *target = arg->target;
-
-  free(arg_in);
-
-  if (to - from <= 1) {
-    return NULL;
-  }
-
-  // point to middle of array
-  int mid = (from + to) / 2;
-
-  // if we have the capacity to create 2 more threads, run merge_sort_aux concurrently 
-  // else run normally
-  if (current_thread_count + 2 < max_thread_count) {
-    current_thread_count += 2;
-    
-    // set arguments for the left side of the array
-    args *arguments = (args *)malloc(sizeof(struct args));
-    arguments->nums = target;
-    arguments->from = from;
-    arguments->to = mid;
-    arguments->target = nums;
-
-    //create a new thread to run merge_sort_aux on left side of array
-    pthread_t tid;
-    pthread_create(&tid, NULL, merge_sort_aux, arguments);
-
-    // set arguments for the right side of the array
-    args *arguments2 = (args *)malloc(sizeof(struct args));
-    arguments2->nums = target;
-    arguments2->from = mid;
-    arguments2->to = to;
-    arguments2->target = nums;
-
-    //create a new thread to run merge_sort_aux on right side of array
-    pthread_t tid2;
-    pthread_create(&tid2, NULL, merge_sort_aux, arguments2);
-
-    // join the threads
-    pthread_join(tid, NULL);
-    pthread_join(tid2, NULL);
-
-    // threads are finished, decrement current thread count
-    current_thread_count -= 2;
-
-    // merge the two lists
-    merge(nums, from, mid, to, target);
-  }
-  else {
-    // initialize arguments for left side
-    args *arguments = (args *)malloc(sizeof(struct args));
-    arguments->nums = target;
-    arguments->from = from;
-    arguments->to = mid;
-    arguments->target = nums;
-
-    // initialize arguments for right side
-    args *arguments2 = (args *)malloc(sizeof(struct args));
-    arguments2->nums = target;
-    arguments2->from = mid;
-    arguments2->to = to;
-    arguments2->target = nums;
-    
-    // run merge sort normally
-    merge_sort_aux(arguments);
-    merge_sort_aux(arguments2);
-    merge(nums, from, mid, to, target);
-  }
-  return NULL;
-}
+  if (binary && !merge) {
+    fprintf(stderr, "Binary input only works with -m\n");
+    return 1;
+  }
+  if (merge && (external || records || argsort || pipelined || lowmem || top >= 0 ||
+                aggregate != AGGREGATE_NONE)) {
+    fprintf(stderr, "Merge mode does not take other modes\n");
+    return 1;
+  }
+  if (merge && argc - optind < 1) {
+    usage(argv[0]);
+    return 1;
+  }
 
+  // the element count is the only positional argument
+  if (!merge && argc - optind != 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
 
-/**
- * Sort the given array and return the sorted version.
- *
- * The result is malloc'd so it is the caller's responsibility to free it.
- *
- * Warning: The source array gets overwritten.
- */
-long *merge_sort(long nums[], int count) {
-  long *result = calloc(count, sizeof(long));
-  assert(result != NULL);
-  memmove(result, nums, count * sizeof(long));
+  struct timeval begin, end;
 
-  int current_thread_count = 1;
-  args *arguments = (args *)malloc(sizeof(struct args));
-  arguments->nums = nums;
-  arguments->from = 0;
-  arguments->to = count;
-  arguments->target = result;
+  // get the number of threads from the environment variable MSORT_THREADS,
+  // "auto" meaning one per available core
+  max_thread_count = topo_thread_count(max_thread_count);
 
-  merge_sort_aux(arguments);
+  // with MSORT_PIN set, the main thread works in the first slot
+  if (topo_pinning()) {
+    char cpus[1024];
+    topo_describe(cpus, sizeof(cpus));
+    log("Pinning workers to CPUs in cache order: %s\n", cpus);
+    topo_pin(0);
+  }
 
-  return result;
-}
+  // Merge mode streams the sorted files through a loser tree
+  if (merge) {
+    return merge_files(&argv[1], argc - 1, binary, max_thread_count) == 0 ? 0 : 1;
+  }
 
+  kernels_init();
 
-/**
- * Based on command line arguments, allocate and populate an input and a 
- * helper array.
- *
- * Returns the number of elements in the array.
- */
-int allocate_load_array(int argc, char **argv, long **array) {
-  assert(argc > 1);
-  int count = atoi(argv[1]);
+  log("Running with %d thread(s), %s engine, %s kernels. Reading input.\n",
+      max_thread_count, engine_names[engine], kernels_isa());
 
-  *array = calloc(count, sizeof(long));
-  assert(*array != NULL);
+  // External mode streams the input through run files instead of loading it
+  if (external) {
+    gettimeofday(&begin, 0);
+    int rv = external_sort(atol(argv[1]), budget_mb * 1024 * 1024, tmp_dir);
+    gettimeofday(&end, 0);
 
-  long element;
-  tty_printf("Enter %d elements, separated by whitespace\n", count);
-  int i = 0;
-  while (i < count && scanf("%ld", &element) != EOF)  {
-    (*array)[i++] = element;
+    log("External sort completed in %f seconds.\n", time_in_secs(&begin, &end));
+    return rv == 0 ? 0 : 1;
   }
 
-  return count;
-}
-
-
-int main(int argc, char **argv) {
-  if (argc != 2) {
-    fprintf(stderr, "Usage: %s <n>\n", argv[0]);
-    return 1;
+  // Record and argsort modes carry the input positions through the sort
+  if (records) {
+    return sort_records(atol(argv[1]), max_thread_count);
+  }
+  if (argsort) {
+    return argsort_keys(atol(argv[1]), max_thread_count);
   }
 
-  struct timeval begin, end;
+  // Pipelined mode overlaps reading, sorting and printing
+  if (pipelined) {
+    gettimeofday(&begin, 0);
+    int rv = pipelined_sort(atol(argv[1]), max_thread_count, aggregate);
+    gettimeofday(&end, 0);
 
-  // get the number of threads from the environment variable SORT_THREADS
-  if (getenv("MSORT_THREADS") != NULL)
-    max_thread_count = atoi(getenv("MSORT_THREADS"));
+    log("Pipelined sort completed in %f seconds.\n", time_in_secs(&begin, &end));
+    return rv == 0 ? 0 : 1;
+  }
 
-  log("Running with %d thread(s). Reading input.\n", max_thread_count);
+  // Top-k mode streams the input and never holds more than k keys per thread
+  if (top >= 0) {
+    return top_k(atol(argv[1]), top, largest, max_thread_count);
+  }
 
   // Read the input
   gettimeofday(&begin, 0);
   long *array = NULL;
-  int count = allocate_load_array(argc, argv, &array);
+  long count = allocate_load_array(argc, argv, &array, max_thread_count);
   gettimeofday(&end, 0);
 
   log("Array read in %f seconds, beginning sort.\n", 
       time_in_secs(&begin, &end));
  
+  // Let a sample of the input pick the engine
+  if (engine == ENGINE_AUTO) {
+    engine = auto_select(array, count, max_thread_count);
+  }
+
   // Sort the array
+  PROF_START();
   gettimeofday(&begin, 0);
-  long *result = merge_sort(array, count);
+  long *result;
+  switch (engine) {
+  case ENGINE_RADIX:
+    result = radix_sort(array, count, max_thread_count, radix_bits);
+    break;
+  case ENGINE_MULTIWAY:
+    result = multiway_sort(array, count, max_thread_count);
+    break;
+  case ENGINE_SAMPLE:
+    result = sample_sort(array, count, max_thread_count);
+    break;
+  case ENGINE_ADAPTIVE:
+    result = adaptive_sort(array, count, max_thread_count);
+    break;
+  default:
+    if (lowmem) {
+      psort_long_lowmem(array, count, max_thread_count);
+      result = array;
+    }
+    else {
+      result = psort_long_copy(array, count, max_thread_count);
+    }
+    break;
+  }
   gettimeofday(&end, 0);
+  PROF_STOP();
   
   log("Sorting completed in %f seconds.\n", time_in_secs(&begin, &end));
+  PROF_WRITE(getenv("MSORT_PROFILE_OUT") != NULL ? getenv("MSORT_PROFILE_OUT")
+                                                  : "tmsort-profile");
+
+  // Collapse the duplicates, every thread its own slice first
+  long *counts = NULL;
+  if (aggregate != AGGREGATE_NONE) {
+    gettimeofday(&begin, 0);
+    if (aggregate == AGGREGATE_COUNT) {
+      counts = psort_alloc(count * sizeof(long), max_thread_count);
+      assert(counts != NULL);
+    }
+    count = aggregate_sorted(result, counts, count, max_thread_count);
+    gettimeofday(&end, 0);
+
+    log("Aggregated to %ld distinct keys in %f seconds.\n", count,
+        time_in_secs(&begin, &end));
+  }
 
   // Print the result
   gettimeofday(&begin, 0);
-  print_long_array(result, count);
+  print_aggregated(result, counts, count);
   gettimeofday(&end, 0);
   
   log("Array printed in %f seconds.\n", time_in_secs(&begin, &end));
+  log("Peak memory use %ld MB.\n", peak_rss_mb());
 
+  if (result != array) {
+    free(result);
+  }
   free(array);
-  free(result);
+  free(counts);
 
   return 0;
 }
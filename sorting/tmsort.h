@@ -0,0 +1,25 @@
+/**
+ * State shared by the tmsort front-end and its engines.
+ */
+#ifndef TMSORT_H
+#define TMSORT_H
+
+#include "sortio.h"
+
+/** The number of threads to be used for sorting. Default: 1 */
+extern int max_thread_count;
+
+/** The sorting algorithms tmsort can run */
+typedef enum engine {
+  ENGINE_MERGE,
+  ENGINE_RADIX,
+  ENGINE_MULTIWAY,
+  ENGINE_SAMPLE,
+  ENGINE_ADAPTIVE,
+  ENGINE_AUTO,      // picked by auto_select() once the input is loaded
+} engine_t;
+
+/** Command line names of the engines, indexed by engine_t */
+extern const char *engine_names[];
+
+#endif
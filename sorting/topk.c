@@ -0,0 +1,188 @@
+/**
+ * Top-k selection over a stream of keys.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "tmsort.h"
+#include "psort.h"
+#include "topk.h"
+#include "topology.h"
+
+// A bounded heap whose root is the worst of the kept keys
+typedef struct topk_heap {
+  long *keys;
+  long len;
+  long cap;
+  int largest;   // keep the largest keys rather than the smallest
+} topk_heap;
+
+// Helper struct to pass custom arguments to pthread_create
+typedef struct topk_args {
+  topk_heap *heap;
+  const long *batch;
+  long from;
+  long to;
+  int slot;
+} topk_args;
+
+
+/**
+ * Whether key a is worse than key b, i.e. would be dropped first.
+ */
+static inline int worse(const topk_heap *h, long a, long b) {
+  return h->largest ? a < b : a > b;
+}
+
+
+static void sift_up(topk_heap *h, long i) {
+  long x = h->keys[i];
+  while (i > 0) {
+    long parent = (i - 1) / 2;
+    if (!worse(h, x, h->keys[parent])) {
+      break;
+    }
+    h->keys[i] = h->keys[parent];
+    i = parent;
+  }
+  h->keys[i] = x;
+}
+
+
+static void sift_down(topk_heap *h, long i) {
+  long x = h->keys[i];
+  for (;;) {
+    long child = 2 * i + 1;
+    if (child >= h->len) {
+      break;
+    }
+    if (child + 1 < h->len && worse(h, h->keys[child + 1], h->keys[child])) {
+      child++;
+    }
+    if (!worse(h, h->keys[child], x)) {
+      break;
+    }
+    h->keys[i] = h->keys[child];
+    i = child;
+  }
+  h->keys[i] = x;
+}
+
+
+/**
+ * Offer a key to the heap, keeping it if it beats the worst kept key.
+ */
+static inline void offer(topk_heap *h, long x) {
+  if (h->len < h->cap) {
+    h->keys[h->len] = x;
+    sift_up(h, h->len++);
+  }
+  else if (worse(h, h->keys[0], x)) {
+    h->keys[0] = x;
+    sift_down(h, 0);
+  }
+}
+
+
+static void *offer_batch(void *arg_in) {
+  topk_args *arg = arg_in;
+  topo_pin(arg->slot);
+  for (long i = arg->from; i < arg->to; i++) {
+    offer(arg->heap, arg->batch[i]);
+  }
+  return NULL;
+}
+
+
+// Read count keys and print the k smallest or largest in ascending order.
+int top_k(long count, long k, int largest, int threads) {
+  struct timeval begin, end;
+  if (threads < 1) {
+    threads = 1;
+  }
+  if (k > count) {
+    k = count;
+  }
+
+  topk_heap *heaps = malloc(threads * sizeof(topk_heap));
+  topk_args *args = malloc(threads * sizeof(topk_args));
+  pthread_t *tids = malloc(threads * sizeof(pthread_t));
+  long *batch = malloc(TOPK_BATCH * sizeof(long));
+  assert(heaps != NULL && args != NULL && tids != NULL && batch != NULL);
+  for (int t = 0; t < threads; t++) {
+    heaps[t].keys = malloc((k > 0 ? k : 1) * sizeof(long));
+    assert(heaps[t].keys != NULL);
+    heaps[t].len = 0;
+    heaps[t].cap = k;
+    heaps[t].largest = largest;
+  }
+
+  // stream the input through the heaps a batch at a time
+  gettimeofday(&begin, 0);
+  tty_printf("Enter %ld elements, separated by whitespace\n", count);
+  long seen = 0;
+  for (;;) {
+    long n = 0;
+    while (seen + n < count && n < TOPK_BATCH && scanf("%ld", &batch[n]) == 1) {
+      n++;
+    }
+    if (n == 0) {
+      break;
+    }
+    seen += n;
+
+    // small batches are not worth the thread start-up
+    int workers = n < threads * 1024L ? 1 : threads;
+    for (int t = 0; t < workers; t++) {
+      args[t].heap = &heaps[t];
+      args[t].batch = batch;
+      args[t].from = n * t / workers;
+      args[t].to = n * (t + 1) / workers;
+      args[t].slot = t;
+    }
+    for (int t = 1; t < workers; t++) {
+      pthread_create(&tids[t], NULL, offer_batch, &args[t]);
+    }
+    offer_batch(&args[0]);
+    for (int t = 1; t < workers; t++) {
+      pthread_join(tids[t], NULL);
+    }
+  }
+  gettimeofday(&end, 0);
+  log("Selected from %ld keys in %f seconds.\n", seen, time_in_secs(&begin, &end));
+
+  // the overall top k are among the union of the per-thread ones
+  gettimeofday(&begin, 0);
+  long total = 0;
+  for (int t = 0; t < threads; t++) {
+    total += heaps[t].len;
+  }
+  long *kept = malloc((total > 0 ? total : 1) * sizeof(long));
+  assert(kept != NULL);
+  total = 0;
+  for (int t = 0; t < threads; t++) {
+    for (long i = 0; i < heaps[t].len; i++) {
+      kept[total++] = heaps[t].keys[i];
+    }
+    free(heaps[t].keys);
+  }
+  psort_long(kept, total, threads);
+  gettimeofday(&end, 0);
+  log("Sorting completed in %f seconds.\n", time_in_secs(&begin, &end));
+
+  long first = k < total ? (largest ? total - k : 0) : 0;
+  long last = k < total ? first + k : total;
+  gettimeofday(&begin, 0);
+  print_long_array(&kept[first], last - first);
+  gettimeofday(&end, 0);
+  log("Array printed in %f seconds.\n", time_in_secs(&begin, &end));
+
+  free(kept);
+  free(batch);
+  free(heaps);
+  free(args);
+  free(tids);
+  return 0;
+}
@@ -0,0 +1,24 @@
+/**
+ * Top-k selection over a stream of keys.
+ */
+#ifndef TOPK_H
+#define TOPK_H
+
+/** Number of keys read from stdin and handed to the workers at a time. */
+#define TOPK_BATCH (1L << 16)
+
+/**
+ * Read up to count keys from stdin and print the k smallest (or, if largest
+ * is set, the k largest) of them in ascending order, one per line.
+ *
+ * The input is consumed in batches of TOPK_BATCH keys. Each batch is split
+ * between the threads, and every thread keeps the best k keys it has seen
+ * in a bounded heap, so keys that cannot make the cut are rejected with a
+ * single comparison. The heaps are merged once the input ends. Memory use is
+ * O(threads * k + TOPK_BATCH) whatever the input size.
+ *
+ * @return 0 on success.
+ */
+int top_k(long count, long k, int largest, int threads);
+
+#endif
@@ -0,0 +1,253 @@
+/**
+ * CPU topology: automatic thread counts and cache-aware pinning.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "topology.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+// Where a CPU sits in the cache hierarchy. The ids are the lowest CPU
+// sharing the core, L2 or last-level cache with it.
+typedef struct cpu_info {
+  int cpu;
+  int sibling;   // 0 for the first hardware thread of its core
+  int package;
+  int llc;
+  int l2;
+  int core;
+} cpu_info;
+
+static cpu_info *order;
+static int ncpus;
+static int ncores;
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+
+/**
+ * Read the first line of a sysfs file into buf. Returns 0 on success.
+ */
+static int read_line(const char *path, char *buf, int len) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  int ok = fgets(buf, len, f) != NULL;
+  fclose(f);
+  return ok ? 0 : -1;
+}
+
+
+/**
+ * Parse a CPU list like "0-3,8-11" into set. Returns the lowest CPU in it,
+ * or -1 if it is empty or unreadable.
+ */
+static int parse_cpu_list(const char *list, cpu_set_t *set) {
+  int lowest = -1;
+  if (set != NULL) {
+    CPU_ZERO(set);
+  }
+  const char *p = list;
+  while (*p != '\0' && *p != '\n') {
+    char *end;
+    long first = strtol(p, &end, 10);
+    if (end == p) {
+      break;
+    }
+    long last = first;
+    if (*end == '-') {
+      p = end + 1;
+      last = strtol(p, &end, 10);
+    }
+    for (long c = first; c <= last && c < CPU_SETSIZE; c++) {
+      if (set != NULL) {
+        CPU_SET(c, set);
+      }
+    }
+    if (lowest == -1 || first < lowest) {
+      lowest = first;
+    }
+    p = *end == ',' ? end + 1 : end;
+  }
+  return lowest;
+}
+
+
+/**
+ * Lowest CPU in the list stored in the given sysfs file, or fallback.
+ */
+static int first_cpu_of(const char *path, int fallback) {
+  char buf[4096];
+  if (read_line(path, buf, sizeof(buf)) != 0) {
+    return fallback;
+  }
+  int first = parse_cpu_list(buf, NULL);
+  return first == -1 ? fallback : first;
+}
+
+
+/**
+ * Find which core, L2 and last-level cache the CPU belongs to.
+ */
+static void probe_cpu(int cpu, cpu_info *info) {
+  char path[256];
+  char buf[64];
+
+  info->cpu = cpu;
+  snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/thread_siblings_list", cpu);
+  info->core = first_cpu_of(path, cpu);
+  info->sibling = info->core != cpu;
+  snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/physical_package_id", cpu);
+  info->package = read_line(path, buf, sizeof(buf)) == 0 ? atoi(buf) : 0;
+
+  // without cache information every core is its own domain
+  info->l2 = info->core;
+  info->llc = info->core;
+  int llc_level = 0;
+  for (int i = 0; ; i++) {
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/level", cpu, i);
+    if (read_line(path, buf, sizeof(buf)) != 0) {
+      break;
+    }
+    int level = atoi(buf);
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/type", cpu, i);
+    if (read_line(path, buf, sizeof(buf)) == 0 && strncmp(buf, "Instruction", 11) == 0) {
+      continue;
+    }
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, i);
+    int shared = first_cpu_of(path, info->core);
+    if (level == 2) {
+      info->l2 = shared;
+    }
+    if (level > llc_level) {
+      llc_level = level;
+      info->llc = shared;
+    }
+  }
+}
+
+
+static int compare_cpus(const void *pa, const void *pb) {
+  const cpu_info *a = pa;
+  const cpu_info *b = pb;
+  int ka[] = {a->sibling, a->package, a->llc, a->l2, a->core, a->cpu};
+  int kb[] = {b->sibling, b->package, b->llc, b->l2, b->core, b->cpu};
+  for (int i = 0; i < 6; i++) {
+    if (ka[i] != kb[i]) {
+      return ka[i] - kb[i];
+    }
+  }
+  return 0;
+}
+
+
+static void probe_topology(void) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    CPU_ZERO(&allowed);
+    CPU_SET(0, &allowed);
+  }
+
+  // CPUs can be in the affinity mask while offline
+  char buf[4096];
+  cpu_set_t online;
+  if (read_line(SYSFS_CPU "/online", buf, sizeof(buf)) == 0 &&
+      parse_cpu_list(buf, &online) != -1) {
+    cpu_set_t both;
+    CPU_AND(&both, &allowed, &online);
+    if (CPU_COUNT(&both) > 0) {
+      allowed = both;
+    }
+  }
+
+  order = malloc(CPU_COUNT(&allowed) * sizeof(cpu_info));
+  if (order == NULL) {
+    return;
+  }
+  for (int c = 0; c < CPU_SETSIZE; c++) {
+    if (CPU_ISSET(c, &allowed)) {
+      probe_cpu(c, &order[ncpus++]);
+    }
+  }
+  qsort(order, ncpus, sizeof(cpu_info), compare_cpus);
+
+  // a core whose first hardware thread is not allowed still counts once
+  for (int i = 0; i < ncpus; i++) {
+    int seen = 0;
+    for (int j = 0; j < i; j++) {
+      seen |= order[j].core == order[i].core;
+    }
+    ncores += !seen;
+  }
+}
+
+
+// Number of threads to use according to MSORT_THREADS.
+int topo_thread_count(int fallback) {
+  const char *env = getenv("MSORT_THREADS");
+  if (env == NULL) {
+    return fallback;
+  }
+  if (strcmp(env, "auto") == 0) {
+    return topo_auto_threads();
+  }
+  return atoi(env);
+}
+
+
+// Number of physical cores the process may run on.
+int topo_auto_threads(void) {
+  pthread_once(&topo_once, probe_topology);
+  return ncores > 0 ? ncores : 1;
+}
+
+
+// Whether MSORT_PIN asks for workers to be pinned to CPUs.
+int topo_pinning(void) {
+  const char *env = getenv("MSORT_PIN");
+  return env != NULL && strcmp(env, "") != 0 && strcmp(env, "0") != 0;
+}
+
+
+// Pin the calling thread to the CPU at the given slot of the cache order.
+void topo_pin(int slot) {
+  if (!topo_pinning()) {
+    return;
+  }
+  pthread_once(&topo_once, probe_topology);
+  if (ncpus == 0) {
+    return;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(order[slot % ncpus].cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+
+// Write the cache order to buf as a space-separated CPU list.
+void topo_describe(char *buf, int len) {
+  pthread_once(&topo_once, probe_topology);
+  int used = 0;
+  buf[0] = '\0';
+  for (int i = 0; i < ncpus && used < len; i++) {
+    used += snprintf(buf + used, len - used, i == 0 ? "%d" : " %d", order[i].cpu);
+  }
+}
+
+
+// Size of the level 2 or level 3 data cache.
+long topo_cache_bytes(int level, long fallback) {
+  long bytes = -1;
+#if defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+  bytes = sysconf(level == 2 ? _SC_LEVEL2_CACHE_SIZE : _SC_LEVEL3_CACHE_SIZE);
+#endif
+  return bytes > 0 ? bytes : fallback;
+}
@@ -0,0 +1,49 @@
+/**
+ * CPU topology: automatic thread counts and cache-aware pinning.
+ *
+ * The CPUs the process may run on (sched_getaffinity() restricted to the
+ * online ones) are put in cache order: one hardware thread of every core
+ * first, grouped so that cores sharing an L2 and then a last-level cache are
+ * neighbours, followed by their SMT siblings in the same order. Workers are
+ * identified by a slot in that order, so a sort that splits its input into
+ * contiguous ranges of slots keeps the data of neighbouring ranges, which it
+ * merges next, in a cache they share.
+ */
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+/**
+ * Number of threads to use: MSORT_THREADS if it is a number, one per
+ * physical core available if it is "auto", and fallback if it is not set.
+ */
+int topo_thread_count(int fallback);
+
+/**
+ * Number of physical cores the process may run on, at least 1.
+ */
+int topo_auto_threads(void);
+
+/**
+ * Whether MSORT_PIN asks for workers to be pinned to CPUs.
+ */
+int topo_pinning(void);
+
+/**
+ * Pin the calling thread to the CPU at the given slot of the cache order,
+ * wrapping around if there are more slots than CPUs. Does nothing unless
+ * pinning is enabled.
+ */
+void topo_pin(int slot);
+
+/**
+ * Write the cache order to buf as a space-separated CPU list.
+ */
+void topo_describe(char *buf, int len);
+
+/**
+ * Size in bytes of the level 2 or level 3 data cache, or fallback if the
+ * system does not report it.
+ */
+long topo_cache_bytes(int level, long fallback);
+
+#endif